@@ -2,22 +2,35 @@
 
 in vec3 surfaceNormal;
 in vec3 toLight[2];
+flat in vec4 instanceMaterial;
 
-uniform float ambientStrength;
-uniform float diffuseStrength;
-uniform float specularStrength;
-uniform float roughness;
-uniform vec3 lightColors[2];
-uniform vec3 surfaceColor;
-uniform vec3 toCamera;
-uniform vec3 fresnel;
-
-uniform bool useBeckmann = true;
-uniform bool useGGX = false;
-uniform bool useG = true;
-uniform bool useF = true;
-uniform bool useDenom = true;
-uniform bool usePi = true;
+// Shared by every program, see UniformBlocks.h.
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 perspective;
+	vec3 toCamera;
+};
+
+layout (std140) uniform Lights
+{
+	vec3 lightPositions[2];
+	vec3 lightColors[2];
+};
+
+// The terms of the BRDF are chosen by defining USE_BECKMANN, USE_GGX,
+// USE_G, USE_F, USE_DENOM and USE_PI, see ShaderPermutations.
+layout (std140) uniform Settings
+{
+	float roughness;
+	float ambientStrength;
+	float diffuseStrength;
+	float specularStrength;
+	vec3 surfaceColor;
+	vec3 fresnel;
+};
+
+uniform bool instanced;
 
 out vec4 fragColor;
 
@@ -25,20 +38,24 @@ out vec4 fragColor;
 #define E 2.7182818284
 #define EPSILON 1e-6
 
+// The uniforms, or the instance's material when instanced. Set in main().
+float materialRoughness;
+vec3 materialColor;
+
 float beckmannNDF(vec3 unitNormal, vec3 midLightCamera)
 {
 	float alpha = acos(max(dot(unitNormal, midLightCamera), 0));
-	float beta = tan(alpha) / roughness;
+	float beta = tan(alpha) / materialRoughness;
 	float exponent = -beta * beta;
 	float num = pow(E, exponent);
 	float cosAlpha = cos(alpha);
-	float denom = PI * roughness * roughness * cosAlpha * cosAlpha * cosAlpha * cosAlpha + EPSILON;
+	float denom = PI * materialRoughness * materialRoughness * cosAlpha * cosAlpha * cosAlpha * cosAlpha + EPSILON;
 	return num / denom;
 }
 
 float ggxNDF(vec3 unitNormal, vec3 midLightCamera)
 {
-	float alpha = roughness * roughness;
+	float alpha = materialRoughness * materialRoughness;
 	float dotNormalMid = max(dot(unitNormal, midLightCamera), 0);
 	float b = dotNormalMid * dotNormalMid * (alpha * alpha - 1) + 1;
 	return (alpha * alpha) / (PI * b * b);
@@ -48,7 +65,7 @@ float geometricAttenuation(vec3 unitToLight, vec3 unitToCamera, vec3 unitNormal)
 {
 	float dotNormalLight = max(dot(unitNormal, unitToLight), 0);
 	float dotNormalCamera = max(dot(unitNormal, unitToCamera), 0);
-	float k = (roughness + 1) * (roughness + 1) / 8.0f;
+	float k = (materialRoughness + 1) * (materialRoughness + 1) / 8.0f;
 	float a = dotNormalLight / (dotNormalLight * (1 - k) + k);
 	float b = dotNormalCamera / (dotNormalCamera * (1 - k) + k);
 	return a * b;
@@ -62,6 +79,9 @@ vec3 fresnelReflectance(vec3 unitToCamera, vec3 midLightCamera)
 
 void main()
 {
+	materialRoughness = instanced ? instanceMaterial.a : roughness;
+	materialColor = instanced ? instanceMaterial.rgb : surfaceColor;
+
 	vec3 finalColor = vec3(0.0f, 0.0f, 0.0f);
 
 	// Ambient color
@@ -82,22 +102,39 @@ void main()
 		float angleNormalLight = max(dot(unitNormal, unitToLight), 0);
 		vec3 lightEnergy = lightColors[i] * angleNormalLight; 
 		
-		diffuse += diffuseStrength * surfaceColor/ pow(PI, int(usePi));
+		diffuse += diffuseStrength * materialColor;
+#ifdef USE_PI
+		diffuse /= PI;
+#endif
 
 		vec3 midLightCamera = normalize(unitToCamera + unitToLight);
 		
-		// Set the bools from the cpu so that at most only one NDF is used at a time.
-		float dBeckmann = useBeckmann ? beckmannNDF(unitNormal, midLightCamera) : 1.0f;
-		float dGGX = useGGX ? ggxNDF(unitNormal, midLightCamera) : 1.0f;
-
-		float g = useG ? geometricAttenuation(unitToLight, unitToCamera, unitNormal) : 1.0f;
-		vec3 f = useF ? fresnelReflectance(unitToCamera, midLightCamera) : vec3(1.0f);
+		// The cpu defines at most one NDF at a time.
+		float dBeckmann = 1.0f;
+		float dGGX = 1.0f;
+#ifdef USE_BECKMANN
+		dBeckmann = beckmannNDF(unitNormal, midLightCamera);
+#endif
+#ifdef USE_GGX
+		dGGX = ggxNDF(unitNormal, midLightCamera);
+#endif
+
+		float g = 1.0f;
+		vec3 f = vec3(1.0f);
+#ifdef USE_G
+		g = geometricAttenuation(unitToLight, unitToCamera, unitNormal);
+#endif
+#ifdef USE_F
+		f = fresnelReflectance(unitToCamera, midLightCamera);
+#endif
 		vec3 num = dBeckmann * dGGX * g * f;
 
 		// Don't clamp these dot products to 0 because they are part
 		// of the denominator.
-		float denom = useDenom ?
-			4 * dot(unitNormal, unitToLight) * dot(unitToCamera, unitNormal) : 1.0f;
+		float denom = 1.0f;
+#ifdef USE_DENOM
+		denom = 4 * dot(unitNormal, unitToLight) * dot(unitToCamera, unitNormal);
+#endif
 
 		specular += specularStrength * num / denom;  
 
@@ -3,21 +3,63 @@
 layout (location = 0) in vec3 inPosition;
 //layout (location = 1) in vec3 inColor;
 layout (location = 1) in vec3 inNormal;
+// Per instance, see Model::setInstances(). The transform takes locations 2 to 5.
+layout (location = 2) in mat4 inInstanceTransform;
+layout (location = 6) in vec4 inInstanceMaterial;
+
+// Shared by every program, see UniformBlocks.h.
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 perspective;
+	vec3 toCamera;
+};
+
+layout (std140) uniform Lights
+{
+	vec3 lightPositions[2];
+	vec3 lightColors[2];
+};
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 perspective;
-uniform vec3 lightPositions[2];
+uniform bool instanced;
+
+// Set when the attributes are a PackedVertex, see VertexPacking.
+uniform bool quantized;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 out vec3 surfaceNormal;
 out vec3 toLight[2];
+flat out vec4 instanceMaterial;
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+	if (n.z < 0.0f)
+	{
+		n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return normalize(n);
+}
 
 void main()
 {
-	vec4 worldPosition = model * vec4(inPosition, 1.0f);
+	vec3 position = inPosition;
+	vec3 normal = inNormal;
+	if (quantized)
+	{
+		position = positionOffset + inPosition * positionScale;
+		normal = decodeOctahedral(inNormal.xy);
+	}
+
+	mat4 world = instanced ? inInstanceTransform * model : model;
+	instanceMaterial = inInstanceMaterial;
+
+	vec4 worldPosition = world * vec4(position, 1.0f);
     gl_Position = perspective * view * worldPosition;
 
-	surfaceNormal = (model * vec4(inNormal, 1.0f)).xyz;
+	surfaceNormal = (world * vec4(normal, 0.0f)).xyz;
 
 	for(int i = 0; i < 2; i++)
 	{
@@ -0,0 +1,102 @@
+#include <limits>
+
+#include "Bounds.h"
+
+/**
+ * True for the bounds of no points at all.
+ */
+bool Bounds::isEmpty() const
+{
+	return minimum.x > maximum.x;
+}
+
+BoundsBuilder::BoundsBuilder() : center(0.0f), radius(0.0f), count(0)
+{
+#ifdef __SSE__
+	minimum = _mm_set1_ps(std::numeric_limits<float>::max());
+	maximum = _mm_set1_ps(std::numeric_limits<float>::lowest());
+#else
+	minimum = glm::vec3(std::numeric_limits<float>::max());
+	maximum = glm::vec3(std::numeric_limits<float>::lowest());
+#endif
+}
+
+/**
+ * Grows the bounds to contain other bounds, e.g. to combine the bounds of
+ * every mesh of a model.
+ */
+void BoundsBuilder::add(const Bounds &bounds)
+{
+	if (bounds.isEmpty())
+	{
+		return;
+	}
+
+#ifdef __SSE__
+	minimum = _mm_min_ps(minimum, _mm_setr_ps(bounds.minimum.x, bounds.minimum.y, bounds.minimum.z, 0.0f));
+	maximum = _mm_max_ps(maximum, _mm_setr_ps(bounds.maximum.x, bounds.maximum.y, bounds.maximum.z, 0.0f));
+#else
+	minimum = glm::min(minimum, bounds.minimum);
+	maximum = glm::max(maximum, bounds.maximum);
+#endif
+
+	if (count == 0)
+	{
+		center = bounds.center;
+		radius = bounds.radius;
+	}
+	else
+	{
+		// Smallest sphere around both spheres.
+		glm::vec3 offset = bounds.center - center;
+		float distance = glm::length(offset);
+		if (distance + bounds.radius > radius)
+		{
+			if (distance + radius <= bounds.radius)
+			{
+				center = bounds.center;
+				radius = bounds.radius;
+			}
+			else
+			{
+				float grownRadius = (radius + distance + bounds.radius) * 0.5f;
+				center += offset * ((grownRadius - radius) / distance);
+				radius = grownRadius;
+			}
+		}
+	}
+	count++;
+}
+
+/**
+ * The sphere is whichever is smaller of the grown sphere and the sphere
+ * around the box.
+ */
+Bounds BoundsBuilder::build() const
+{
+	Bounds bounds;
+#ifdef __SSE__
+	float values[4];
+	_mm_storeu_ps(values, minimum);
+	bounds.minimum = glm::vec3(values[0], values[1], values[2]);
+	_mm_storeu_ps(values, maximum);
+	bounds.maximum = glm::vec3(values[0], values[1], values[2]);
+#else
+	bounds.minimum = minimum;
+	bounds.maximum = maximum;
+#endif
+
+	// The grown sphere may miss the points it grew to by rounding.
+	bounds.center = center;
+	bounds.radius = radius * (1.0f + 1e-5f);
+	if (count > 0)
+	{
+		float boxRadius = glm::length(bounds.maximum - bounds.minimum) * 0.5f;
+		if (boxRadius < bounds.radius)
+		{
+			bounds.center = (bounds.minimum + bounds.maximum) * 0.5f;
+			bounds.radius = boxRadius;
+		}
+	}
+	return bounds;
+}
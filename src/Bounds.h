@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+ * Axis aligned bounding box and bounding sphere of a set of points,
+ * built in a single pass so it can be folded into any loop that
+ * already visits the points. The box uses SSE min/max when available.
+ */
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+struct Bounds
+{
+	glm::vec3 minimum;
+	glm::vec3 maximum;
+	glm::vec3 center;		// of the bounding sphere
+	float radius;
+
+	bool isEmpty() const;
+};
+
+class BoundsBuilder
+{
+	public:
+		BoundsBuilder();
+
+		/**
+		 * Grows the box with min/max and the sphere like the second pass of
+		 * Ritter's algorithm, moving it just enough to contain the point.
+		 */
+		void add(const glm::vec3 &point)
+		{
+#ifdef __SSE__
+			__m128 p = _mm_setr_ps(point.x, point.y, point.z, 0.0f);
+			minimum = _mm_min_ps(minimum, p);
+			maximum = _mm_max_ps(maximum, p);
+#else
+			minimum = glm::min(minimum, point);
+			maximum = glm::max(maximum, point);
+#endif
+			if (count++ == 0)
+			{
+				center = point;
+				return;
+			}
+
+			glm::vec3 offset = point - center;
+			float distanceSquared = glm::dot(offset, offset);
+			if (distanceSquared > radius * radius)
+			{
+				float distance = glm::sqrt(distanceSquared);
+				float grownRadius = (radius + distance) * 0.5f;
+				center += offset * ((grownRadius - radius) / distance);
+				radius = grownRadius;
+			}
+		}
+
+		void add(const Bounds &bounds);
+		Bounds build() const;
+
+	private:
+#ifdef __SSE__
+		__m128 minimum;
+		__m128 maximum;
+#else
+		glm::vec3 minimum;
+		glm::vec3 maximum;
+#endif
+		glm::vec3 center;
+		float radius;
+		size_t count;
+};
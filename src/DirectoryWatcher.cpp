@@ -0,0 +1,72 @@
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+#include "DirectoryWatcher.h"
+
+DirectoryWatcher::DirectoryWatcher(const std::string &directory) :
+	directory(directory), fd(-1), watch(-1)
+{
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+	{
+		std::cerr << "Could not start watching " << directory << std::endl;
+		return;
+	}
+
+	// Editors either write the file in place or write a copy and rename it.
+	watch = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (watch < 0)
+	{
+		std::cerr << "Could not start watching " << directory << std::endl;
+		close(fd);
+		fd = -1;
+	}
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+}
+
+bool DirectoryWatcher::isWatching() const
+{
+	return fd >= 0;
+}
+
+/**
+ * Returns the paths of the files changed since the last poll, each once.
+ */
+std::vector<std::string> DirectoryWatcher::poll()
+{
+	std::vector<std::string> changed;
+	if (fd < 0)
+	{
+		return changed;
+	}
+
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (ssize_t offset = 0; offset < length; )
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			if (event->len > 0 && !(event->mask & IN_ISDIR))
+			{
+				std::string path = (std::filesystem::path(directory) / event->name).string();
+				if (std::find(changed.begin(), changed.end(), path) == changed.end())
+				{
+					changed.push_back(path);
+				}
+			}
+			offset += sizeof(inotify_event) + event->len;
+		}
+	}
+	return changed;
+}
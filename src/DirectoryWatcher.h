@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+ * Watches a directory with inotify and reports the files in it that
+ * were written or moved into it. Polling never blocks, so it can be
+ * called once per frame.
+ */
+
+#include <string>
+#include <vector>
+
+class DirectoryWatcher
+{
+	public:
+		DirectoryWatcher(const std::string &directory);
+		~DirectoryWatcher();
+		DirectoryWatcher(const DirectoryWatcher&) = delete;
+		DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+		bool isWatching() const;
+		std::vector<std::string> poll();
+
+	private:
+		std::string directory;
+		int fd;
+		int watch;
+};
@@ -0,0 +1,68 @@
+#include <glad/glad.h>
+#include <algorithm>
+
+#include "DrawQueue.h"
+
+DrawQueue::DrawQueue() : statistics()
+{
+}
+
+/**
+ * Queues drawing the model, which must be uploaded, with placement applied
+ * after its own transformation.
+ */
+void DrawQueue::add(Model* model, const glm::mat4 &placement)
+{
+	draws.push_back({ model, placement, model->getShader().getId(), model->getVertexArrayId() });
+}
+
+/**
+ * Culls and draws everything queued since the last call, grouped by program
+ * and vertex array, and empties the queue.
+ */
+void DrawQueue::submit(const glm::mat4 &view, const glm::mat4 &perspective, float viewportHeight)
+{
+	std::stable_sort(draws.begin(), draws.end(), [](const Draw &a, const Draw &b) {
+		return a.program != b.program ? a.program < b.program : a.vertexArray < b.vertexArray;
+	});
+
+	statistics = {};
+	statistics.draws = draws.size();
+	unsigned int program = 0;
+	unsigned int vertexArray = 0;
+	for (auto &draw : draws)
+	{
+		// Placing the model is the same as moving the camera the other way.
+		draw.model->prepareDraw(view * draw.placement, perspective, viewportHeight);
+		const Model::DrawStatistics &culled = draw.model->getDrawStatistics();
+		statistics.models.instances += culled.instances;
+		statistics.models.triangles += culled.triangles;
+		statistics.models.meshesTested += culled.meshesTested;
+		statistics.models.meshesCulled += culled.meshesCulled;
+		statistics.models.meshletsTested += culled.meshletsTested;
+		statistics.models.meshletsCulled += culled.meshletsCulled;
+
+		if (draw.program != program)
+		{
+			draw.model->getShader().use();
+			program = draw.program;
+			statistics.programChanges++;
+		}
+		if (draw.vertexArray != vertexArray)
+		{
+			glBindVertexArray(draw.vertexArray);
+			vertexArray = draw.vertexArray;
+			statistics.vertexArrayChanges++;
+		}
+		statistics.drawCalls += draw.model->submitDraws(draw.placement);
+	}
+	draws.clear();
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+const DrawQueue::Statistics& DrawQueue::getStatistics() const
+{
+	return statistics;
+}
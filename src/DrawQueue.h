@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * Draws several models together, e.g. every model of a scene. The
+ * queued draws are sorted by shader program and vertex array, so each
+ * is bound once for all the draws that share it instead of once per
+ * model, and the draw calls and state changes of the last submit()
+ * are counted.
+ */
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Model.h"
+
+class DrawQueue
+{
+	public:
+		/**
+		 * What the last submit() did.
+		 *	draws: Models drawn, counting a model placed twice twice.
+		 *	drawCalls: glDraw* calls issued for them.
+		 *	programChanges, vertexArrayChanges: Binds of another program or vertex array.
+		 *	models: The DrawStatistics of every draw added up.
+		 */
+		struct Statistics
+		{
+			size_t draws;
+			size_t drawCalls;
+			size_t programChanges;
+			size_t vertexArrayChanges;
+			Model::DrawStatistics models;
+		};
+
+		DrawQueue();
+		void add(Model* model, const glm::mat4 &placement = glm::mat4(1.0f));
+		void submit(const glm::mat4 &view, const glm::mat4 &perspective, float viewportHeight);
+		const Statistics& getStatistics() const;
+
+	private:
+		struct Draw
+		{
+			Model* model;
+			glm::mat4 placement;
+			unsigned int program;
+			unsigned int vertexArray;
+		};
+
+		std::vector<Draw> draws;
+		Statistics statistics;
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * 64 bit FNV-1a hash. Pass the hash of the data before to continue it.
+ */
+inline uint64_t hash(const char* data, size_t size, uint64_t h = 14695981039346656037ull)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		h ^= static_cast<unsigned char>(data[i]);
+		h *= 1099511628211ull;
+	}
+	return h;
+}
@@ -0,0 +1,51 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const std::string &path) : mapping(nullptr), length(0)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address != MAP_FAILED)
+		{
+			mapping = static_cast<const char*>(address);
+			length = info.st_size;
+		}
+	}
+	// The mapping stays valid after the descriptor is closed.
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (mapping)
+	{
+		munmap(const_cast<char*>(mapping), length);
+	}
+}
+
+bool MappedFile::isOpen() const
+{
+	return mapping != nullptr;
+}
+
+const char* MappedFile::data() const
+{
+	return mapping;
+}
+
+size_t MappedFile::size() const
+{
+	return length;
+}
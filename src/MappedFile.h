@@ -0,0 +1,26 @@
+#pragma once
+
+/*
+ * Read-only memory mapping of a whole file. The mapping
+ * is released when the object is destroyed.
+ */
+
+#include <string>
+#include <cstddef>
+
+class MappedFile
+{
+	public:
+		MappedFile(const std::string &path);
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool isOpen() const;
+		const char* data() const;
+		size_t size() const;
+
+	private:
+		const char* mapping;
+		size_t length;
+};
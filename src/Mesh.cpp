@@ -1,24 +1,64 @@
-#include <glad/glad.h>
+#include <algorithm>
 
 #include "Mesh.h"
+#include "NormalGenerator.h"
 
-Mesh::Mesh(const aiMesh* mesh)
+/**
+ * Only extracts the data from the mesh. This does not touch OpenGL so it
+ * can run on any thread. Call upload() on the context thread before drawing.
+ */
+Mesh::Mesh(const aiMesh* mesh) :
+	lodIndexData(nullptr), lodIndexCount(0), lodData(nullptr), lodCount(0),
+	meshletData(nullptr), meshletCount(0), closed(false)
 {
 	extractDataFromMesh(mesh);
-	vertexArray = new VertexArray(vertices, indices);
 }
 
-Mesh::~Mesh()
+/**
+ * Takes ownership of data that was already extracted, e.g. by the ObjParser.
+ */
+Mesh::Mesh(std::vector<Vertex>&& vertices, std::vector<unsigned int>&& indices) :
+	vertices(std::move(vertices)), indices(std::move(indices)),
+	lodIndexData(nullptr), lodIndexCount(0), lodData(nullptr), lodCount(0),
+	meshletData(nullptr), meshletCount(0), closed(false)
+{
+	vertexData = this->vertices.data();
+	vertexCount = this->vertices.size();
+	indexData = this->indices.data();
+	indexCount = this->indices.size();
+
+	BoundsBuilder builder;
+	for (auto &vertex : this->vertices)
+	{
+		builder.add(vertex.position);
+	}
+	bounds = builder.build();
+}
+
+/**
+ * Uses data owned by someone else without copying it. The data must stay
+ * valid until upload() has been called, after which it is no longer used.
+ * The bounds were computed when the data was extracted.
+ */
+Mesh::Mesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+		const Bounds &bounds) :
+	vertexData(vertices), vertexCount(vertexCount), indexData(indices), indexCount(indexCount),
+	bounds(bounds), lodIndexData(nullptr), lodIndexCount(0), lodData(nullptr), lodCount(0),
+	meshletData(nullptr), meshletCount(0), closed(false)
 {
-	delete vertexArray;
 }
 
+Mesh::~Mesh() {}
+
 /**
- * Fills the buffer with the vertex data from the mesh.
+ * Fills the buffer with the vertex data from the mesh, and computes the
+ * bounds while visiting the positions.
  */
 void Mesh::extractDataFromMesh(const aiMesh* mesh)
 {
 	// First, extract all the vertex data, i.e. position, normal, etc.
+	BoundsBuilder builder;
+	vertices.reserve(mesh->mNumVertices);
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
 		Vertex vertex;
@@ -28,6 +68,7 @@ void Mesh::extractDataFromMesh(const aiMesh* mesh)
 		vector.y = mesh->mVertices[i].y;
 		vector.z = mesh->mVertices[i].z;
 		vertex.position = vector;
+		builder.add(vector);
 
 		if (mesh->HasNormals())
 		{
@@ -38,6 +79,7 @@ void Mesh::extractDataFromMesh(const aiMesh* mesh)
 		}
 		vertices.push_back(vertex);
 	}
+	bounds = builder.build();
 
 	// Now, store the indices by iterating over the meshes faces.
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
@@ -49,11 +91,355 @@ void Mesh::extractDataFromMesh(const aiMesh* mesh)
 			indices.push_back(face.mIndices[j]);
 		}
 	}	
+
+	vertexData = vertices.data();
+	vertexCount = vertices.size();
+	indexData = indices.data();
+	indexCount = indices.size();
+}
+
+/**
+ * Replaces the normals with smooth ones, see NormalGenerator. Only meshes
+ * that own their data generate normals, borrowed data already has them.
+ */
+void Mesh::generateNormals(float creaseAngle)
+{
+	NormalGenerator::generate(vertices, indices, creaseAngle);
+}
+
+/**
+ * Welds identical vertices, then reorders the triangles for the vertex cache,
+ * optionally sorts them to reduce overdraw (0 disables it) and reorders the
+ * vertices for fetch locality. Only meshes that own their data are optimized,
+ * borrowed data was optimized before it was stored.
+ */
+void Mesh::optimize(float overdrawThreshold, MeshOptimizer::Statistics &before, MeshOptimizer::Statistics &after)
+{
+	before = MeshOptimizer::analyze(vertexData, vertexCount, indexData, indexCount);
+
+	if (!vertices.empty())
+	{
+		MeshOptimizer::weldVertices(vertices, indices);
+		MeshOptimizer::optimizeVertexCache(vertices.size(), indices);
+		if (overdrawThreshold > 0.0f)
+		{
+			MeshOptimizer::optimizeOverdraw(vertices, indices, overdrawThreshold);
+		}
+		MeshOptimizer::optimizeVertexFetch(vertices, indices);
+
+		vertexData = vertices.data();
+		vertexCount = vertices.size();
+		indexData = indices.data();
+		indexCount = indices.size();
+	}
+
+	after = MeshOptimizer::analyze(vertexData, vertexCount, indexData, indexCount);
+}
+
+/**
+ * Builds up to maxLods simplified versions of the mesh, each with about half
+ * the triangles of the previous one, stopping once simplifying stops paying
+ * off. Identical vertices are welded first since only connected triangles
+ * can be simplified. Only meshes that own their data build levels of detail,
+ * borrowed data comes with its own, see setLods().
+ */
+void Mesh::buildLods(unsigned int maxLods)
+{
+	if (vertices.empty())
+	{
+		return;
+	}
+
+	MeshOptimizer::weldVertices(vertices, indices);
+	vertexData = vertices.data();
+	vertexCount = vertices.size();
+
+	lodIndices.clear();
+	lods.clear();
+	size_t previousCount = indices.size();
+	float previousError = 0.0f;
+	for (unsigned int i = 1; i <= maxLods; i++)
+	{
+		float error;
+		std::vector<unsigned int> simplified = MeshOptimizer::simplify(vertices, indices, indices.size() >> i, error);
+		if (simplified.empty() || simplified.size() > previousCount * 3 / 4)
+		{
+			break;
+		}
+		MeshOptimizer::optimizeVertexCache(vertices.size(), simplified);
+
+		// A coarser level is never more accurate than a finer one.
+		previousError = std::max(previousError, error);
+		lods.push_back({ uint32_t(lodIndices.size()), uint32_t(simplified.size()), previousError });
+		lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+		previousCount = simplified.size();
+	}
+
+	lodIndexData = lodIndices.data();
+	lodIndexCount = lodIndices.size();
+	lodData = lods.data();
+	lodCount = lods.size();
+}
+
+/**
+ * Uses levels of detail owned by someone else, such as a mapped MeshCache.
+ */
+void Mesh::setLods(const unsigned int* indices, size_t indexCount, const Lod* lods, size_t lodCount)
+{
+	lodIndexData = indices;
+	lodIndexCount = indexCount;
+	lodData = lods;
+	this->lodCount = lodCount;
+}
+
+/**
+ * Groups the triangles of the full mesh into meshlets that can be culled on
+ * their own, which reorders the triangles. Only meshes that own their data
+ * build meshlets, borrowed data comes with its own, see setMeshlets().
+ */
+void Mesh::buildMeshlets()
+{
+	if (vertices.empty())
+	{
+		return;
+	}
+
+	closed = MeshOptimizer::isClosed(vertexData, vertexCount, indices.data(), indices.size());
+	meshlets = MeshOptimizer::buildMeshlets(vertexData, vertexCount, indices,
+			MeshOptimizer::meshletVertices, MeshOptimizer::meshletTriangles);
+	indexData = indices.data();
+	indexCount = indices.size();
+	meshletData = meshlets.data();
+	meshletCount = meshlets.size();
+}
+
+/**
+ * Uses meshlets owned by someone else, such as a mapped MeshCache, built
+ * from a mesh that was closed or not.
+ */
+void Mesh::setMeshlets(const MeshOptimizer::Meshlet* meshlets, size_t meshletCount, bool closed)
+{
+	meshletData = meshlets;
+	this->meshletCount = meshletCount;
+	this->closed = closed;
+}
+
+/**
+ * Sends the extracted data to the GPU into the vertex array shared with the
+ * other meshes of the model, packing the vertices first if the vertex array
+ * holds PackedVertex, and narrowing the indices to uint16_t if the mesh is
+ * small enough. Must be called on the thread that owns the OpenGL context.
+ *
+ * If uploads is set the copies are only queued. The data they read, including
+ * the packed and narrowed copies kept here, must then stay valid until they
+ * are done. Either way releaseUploadData() must be called once they are.
+ */
+void Mesh::upload(VertexArray &vertexArray, const VertexPacking &packing, UploadManager* uploads)
+{
+	const void* vertexSource = vertexData;
+	if (vertexArray.getFormat() == VertexArray::Packed)
+	{
+		packedVertices.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			packedVertices[i] = packing.pack(vertexData[i]);
+		}
+		vertexSource = packedVertices.data();
+	}
+
+	// Every level's indices are narrowed up front, the copies may happen later.
+	const bool narrow = getIndexSize() == sizeof(uint16_t);
+	if (narrow)
+	{
+		shortIndices.assign(indexData, indexData + indexCount);
+		shortIndices.insert(shortIndices.end(), lodIndexData, lodIndexData + lodIndexCount);
+	}
+
+	const void* indexSource = narrow ? static_cast<const void*>(shortIndices.data()) : indexData;
+	ranges.clear();
+	ranges.push_back(vertexArray.add(vertexSource, vertexCount, indexSource, indexCount, getIndexSize(), uploads));
+
+	// The levels of detail index the same vertices.
+	for (size_t i = 0; i < lodCount; i++)
+	{
+		const void* levelSource = narrow ?
+			static_cast<const void*>(shortIndices.data() + indexCount + lodData[i].firstIndex) :
+			lodIndexData + lodData[i].firstIndex;
+		ranges.push_back(vertexArray.addIndices(levelSource, lodData[i].indexCount, getIndexSize(),
+					ranges[0].baseVertex, uploads));
+	}
+
+}
+
+/**
+ * Frees the packed vertices and narrowed indices upload() made, and whatever
+ * the residency doesn't keep of the data that is now on the GPU. Borrowed
+ * data is only kept with Keep, otherwise the owner may release it afterwards.
+ */
+void Mesh::releaseUploadData(Residency residency)
+{
+	std::vector<PackedVertex>().swap(packedVertices);
+	std::vector<uint16_t>().swap(shortIndices);
+
+	// The level of detail errors and meshlets are still needed to select and
+	// cull them, so they are never released and borrowed ones are copied.
+	if (residency != Keep && lodData != lods.data())
+	{
+		lods.assign(lodData, lodData + lodCount);
+		lodData = lods.data();
+	}
+	if (residency != Keep && meshletData != meshlets.data())
+	{
+		meshlets.assign(meshletData, meshletData + meshletCount);
+		meshletData = meshlets.data();
+	}
+
+	if (residency == Compact)
+	{
+		positions.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			positions[i] = vertexData[i].position;
+		}
+		if (indexData != indices.data())
+		{
+			indices.assign(indexData, indexData + indexCount);
+			indexData = indices.data();
+		}
+	}
+
+	if (residency != Keep)
+	{
+		std::vector<Vertex>().swap(vertices);
+		vertexData = nullptr;
+		std::vector<unsigned int>().swap(lodIndices);
+		lodIndexData = nullptr;
+	}
+	if (residency == Drop)
+	{
+		std::vector<unsigned int>().swap(indices);
+		indexData = nullptr;
+	}
+}
+
+/**
+ * Where upload() placed a level of detail, 0 being the full mesh.
+ */
+const VertexArray::Range& Mesh::getRange(size_t lod) const
+{
+	return ranges[lod];
+}
+
+const Vertex* Mesh::getVertexData() const
+{
+	return vertexData;
+}
+
+size_t Mesh::getVertexCount() const
+{
+	return vertexCount;
+}
+
+const unsigned int* Mesh::getIndexData() const
+{
+	return indexData;
+}
+
+size_t Mesh::getIndexCount() const
+{
+	return indexCount;
+}
+
+/**
+ * Size of one index once uploaded, 2 or 4 bytes.
+ */
+size_t Mesh::getIndexSize() const
+{
+	return vertexCount <= shortIndexLimit ? sizeof(uint16_t) : sizeof(unsigned int);
+}
+
+const unsigned int* Mesh::getLodIndexData() const
+{
+	return lodIndexData;
 }
 
-void Mesh::draw() const
+size_t Mesh::getLodIndexCount() const
+{
+	return lodIndexCount;
+}
+
+const Mesh::Lod* Mesh::getLodData() const
+{
+	return lodData;
+}
+
+/**
+ * Number of simplified levels of detail, not counting the full mesh.
+ */
+size_t Mesh::getLodCount() const
+{
+	return lodCount;
+}
+
+/**
+ * How far a level of detail is from the full mesh, 0 being the full mesh.
+ */
+float Mesh::getLodError(size_t lod) const
+{
+	return lod == 0 ? 0.0f : lodData[lod - 1].error;
+}
+
+const MeshOptimizer::Meshlet* Mesh::getMeshletData() const
+{
+	return meshletData;
+}
+
+size_t Mesh::getMeshletCount() const
+{
+	return meshletCount;
+}
+
+/**
+ * True if the meshlets were built from a closed mesh, so the ones facing
+ * away from the camera can be culled.
+ */
+bool Mesh::isClosed() const
+{
+	return closed;
+}
+
+const Bounds& Mesh::getBounds() const
+{
+	return bounds;
+}
+
+/**
+ * Size of the mesh data, whether owned or borrowed: vertices, indices,
+ * levels of detail and meshlets.
+ */
+size_t Mesh::getDataBytes() const
+{
+	return vertexCount * sizeof(Vertex) + (indexCount + lodIndexCount) * sizeof(unsigned int) +
+		lodCount * sizeof(Lod) + meshletCount * sizeof(MeshOptimizer::Meshlet);
+}
+
+/**
+ * The positions kept by the Compact residency, nullptr before the mesh was
+ * uploaded or with any other residency.
+ */
+const glm::vec3* Mesh::getPositionData() const
+{
+	return positions.empty() ? nullptr : positions.data();
+}
+
+/**
+ * Size of the memory the mesh owns, which doesn't include borrowed data.
+ */
+size_t Mesh::getResidentBytes() const
 {
-	vertexArray->bind();
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	return vertices.capacity() * sizeof(Vertex) + positions.capacity() * sizeof(glm::vec3) +
+		(indices.capacity() + lodIndices.capacity()) * sizeof(unsigned int) +
+		lods.capacity() * sizeof(Lod) + meshlets.capacity() * sizeof(MeshOptimizer::Meshlet) +
+		ranges.capacity() * sizeof(VertexArray::Range) + packedVertices.capacity() * sizeof(PackedVertex) +
+		shortIndices.capacity() * sizeof(uint16_t);
 }
@@ -1,19 +1,105 @@
+#pragma once
+
 #include <vector>
 #include <assimp/scene.h>
 
 #include "Vertex.h"
 #include "VertexArray.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "Bounds.h"
 
 class Mesh
 {
 	public:
+		// Meshes with at most this many vertices are drawn with uint16_t indices.
+		static const size_t shortIndexLimit = 65536;
+
+		/**
+		 * A simplified level of detail. Its indices start at firstIndex in
+		 * getLodIndexData() and use the same vertices as the full mesh.
+		 * error is how far, in model units, it is from the full mesh.
+		 */
+		struct Lod
+		{
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			float error;
+		};
+
+		/**
+		 * What a mesh keeps in memory once it is on the GPU, see
+		 * releaseUploadData().
+		 */
+		enum Residency
+		{
+			Keep,		// all of its data
+			Drop,		// only what drawing needs: bounds, levels of detail and meshlets
+			Compact		// also the positions and indices, e.g. for picking
+		};
+
 		Mesh(const aiMesh* mesh);
+		Mesh(std::vector<Vertex>&& vertices, std::vector<unsigned int>&& indices);
+		Mesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+				const Bounds &bounds);
 		~Mesh();
-		void draw() const;
+		void upload(VertexArray &vertexArray, const VertexPacking &packing, UploadManager* uploads = nullptr);
+		void releaseUploadData(Residency residency);
+		const VertexArray::Range& getRange(size_t lod = 0) const;
 		void extractDataFromMesh(const aiMesh* mesh);
+		void generateNormals(float creaseAngle);
+		void optimize(float overdrawThreshold, MeshOptimizer::Statistics &before, MeshOptimizer::Statistics &after);
+		void buildLods(unsigned int maxLods);
+		void setLods(const unsigned int* indices, size_t indexCount, const Lod* lods, size_t lodCount);
+		void buildMeshlets();
+		void setMeshlets(const MeshOptimizer::Meshlet* meshlets, size_t meshletCount, bool closed);
+
+		const Vertex* getVertexData() const;
+		const glm::vec3* getPositionData() const;
+		size_t getVertexCount() const;
+		const unsigned int* getIndexData() const;
+		size_t getIndexCount() const;
+		size_t getIndexSize() const;
+		const unsigned int* getLodIndexData() const;
+		size_t getLodIndexCount() const;
+		const Lod* getLodData() const;
+		size_t getLodCount() const;
+		float getLodError(size_t lod) const;
+		const MeshOptimizer::Meshlet* getMeshletData() const;
+		size_t getMeshletCount() const;
+		bool isClosed() const;
+		const Bounds& getBounds() const;
+		size_t getDataBytes() const;
+		size_t getResidentBytes() const;
 
 	private:
 		std::vector<Vertex> vertices;
 		std::vector<unsigned int> indices;
-		VertexArray* vertexArray;
+
+		// The data to upload. Either points into the vectors above or into
+		// memory owned by someone else, such as a mapped MeshCache.
+		const Vertex* vertexData;
+		size_t vertexCount;
+		const unsigned int* indexData;
+		size_t indexCount;
+		Bounds bounds;
+
+		// The simplified levels of detail, owned or borrowed like above.
+		std::vector<unsigned int> lodIndices;
+		std::vector<Lod> lods;
+		const unsigned int* lodIndexData;
+		size_t lodIndexCount;
+		const Lod* lodData;
+		size_t lodCount;
+
+		// Clusters of the full mesh for culling, owned or borrowed like above.
+		std::vector<MeshOptimizer::Meshlet> meshlets;
+		const MeshOptimizer::Meshlet* meshletData;
+		size_t meshletCount;
+		bool closed;				// meshlets may be culled when facing away, see MeshOptimizer::isClosed()
+
+		std::vector<glm::vec3> positions;	// kept by the Compact residency
+		std::vector<VertexArray::Range> ranges;	// where upload() placed each level of detail
+		std::vector<PackedVertex> packedVertices;	// converted by upload() until the copies are done
+		std::vector<uint16_t> shortIndices;
 };
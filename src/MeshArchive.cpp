@@ -0,0 +1,199 @@
+#include <iostream>
+#include <filesystem>
+#include <cstring>
+
+#include "MeshArchive.h"
+
+namespace
+{
+	const char magic[8] = { 'M', 'E', 'S', 'H', 'P', 'A', 'C', 'K' };
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t entryCount;
+		uint64_t entryOffset;	// of the table of contents
+		uint64_t nameOffset;	// of the names the entries point into
+		uint64_t nameSize;
+	};
+
+	struct TocEntry
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint64_t nameOffset;	// relative to Header::nameOffset
+		uint64_t nameLength;
+	};
+
+	/**
+	 * True if count elements of elementSize bytes starting at offset lie
+	 * within size bytes, checked such that corrupt values can't overflow.
+	 */
+	bool fits(uint64_t offset, uint64_t count, size_t elementSize, uint64_t size)
+	{
+		return offset <= size && count <= (size - offset) / elementSize;
+	}
+
+	void pad(std::ostream &out)
+	{
+		static const char zeros[MeshArchive::alignment] = {};
+		uint64_t offset = out.tellp();
+		uint64_t aligned = (offset + MeshArchive::alignment - 1) & ~(MeshArchive::alignment - 1);
+		out.write(zeros, aligned - offset);
+	}
+}
+
+/**
+ * Starts writing the archive. It is written under a temporary name and only
+ * renamed to path by finish().
+ */
+MeshArchive::Writer::Writer(const std::string &path) :
+	path(path), tempPath(path + ".tmp"), out(tempPath, std::ios::binary | std::ios::trunc)
+{
+	// Reserve the header, it is written once the table of contents is known.
+	Header header = {};
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+/**
+ * Returns the stream to write the cache of the named model to.
+ */
+std::ostream& MeshArchive::Writer::beginModel(const std::string &name)
+{
+	pad(out);
+	entries.push_back({ name, uint64_t(out.tellp()), 0 });
+	return out;
+}
+
+/**
+ * Ends the model started by beginModel(). If it wasn't written it is left
+ * out of the table of contents.
+ */
+void MeshArchive::Writer::endModel(bool written)
+{
+	if (written)
+	{
+		entries.back().size = uint64_t(out.tellp()) - entries.back().offset;
+	}
+	else
+	{
+		entries.pop_back();
+	}
+}
+
+/**
+ * Writes the table of contents and the header. Returns false if anything
+ * could not be written, in which case no archive is left behind.
+ */
+bool MeshArchive::Writer::finish()
+{
+	Header header = {};
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.entryCount = entries.size();
+
+	std::string names;
+	std::vector<TocEntry> table;
+	for (auto &entry : entries)
+	{
+		table.push_back({ entry.offset, entry.size, names.size(), entry.name.size() });
+		names += entry.name;
+	}
+
+	pad(out);
+	header.entryOffset = out.tellp();
+	out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(TocEntry));
+	header.nameOffset = out.tellp();
+	header.nameSize = names.size();
+	out.write(names.data(), names.size());
+
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.close();
+
+	bool written = bool(out);
+	std::error_code error;
+	if (written)
+	{
+		std::filesystem::rename(tempPath, path, error);
+	}
+
+	if (!written || error)
+	{
+		std::cerr << "Could not write mesh archive " << path << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Maps the archive and reads its table of contents.
+ */
+MeshArchive::MeshArchive(const std::string &path) : file(path), valid(false)
+{
+	const char* data = file.data();
+	size_t size = file.size();
+
+	const Header* header = reinterpret_cast<const Header*>(data);
+	valid = file.isOpen() && size >= sizeof(Header) &&
+		memcmp(header->magic, magic, sizeof(magic)) == 0 &&
+		header->version == version &&
+		header->entryOffset % alignof(TocEntry) == 0 &&
+		fits(header->entryOffset, header->entryCount, sizeof(TocEntry), size) &&
+		fits(header->nameOffset, header->nameSize, 1, size);
+
+	if (valid)
+	{
+		const TocEntry* entries = reinterpret_cast<const TocEntry*>(data + header->entryOffset);
+		for (uint32_t i = 0; i < header->entryCount && valid; i++)
+		{
+			const TocEntry &entry = entries[i];
+			// Every cache starts aligned, which its own offsets rely on.
+			valid = entry.offset % alignment == 0 && fits(entry.offset, entry.size, 1, size) &&
+				fits(entry.nameOffset, entry.nameLength, 1, header->nameSize);
+			if (valid)
+			{
+				std::string name(data + header->nameOffset + entry.nameOffset, entry.nameLength);
+				names.push_back(name);
+				slices[name] = { data + entry.offset, entry.size };
+			}
+		}
+	}
+
+	if (!valid)
+	{
+		std::cerr << "Could not read mesh archive " << path << std::endl;
+		names.clear();
+		slices.clear();
+	}
+}
+
+bool MeshArchive::isOpen() const
+{
+	return valid;
+}
+
+/**
+ * The names of the models in the order they were packed.
+ */
+const std::vector<std::string>& MeshArchive::getNames() const
+{
+	return names;
+}
+
+/**
+ * Returns the cache of the model whose file name matches the one of path,
+ * still to be loaded, or nullptr if the archive has no such model. The cache
+ * points into the archive, which must outlive it.
+ */
+MeshCache* MeshArchive::open(const std::string &path, uint64_t importFlags) const
+{
+	auto slice = slices.find(std::filesystem::path(path).filename().string());
+	if (slice == slices.end())
+	{
+		return nullptr;
+	}
+	return new MeshCache(slice->second.data, slice->second.size, importFlags);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ * A single file holding the MeshCache of every model in a directory,
+ * written with --pack. Opening it is one open and one mmap, after
+ * which each model is a MeshCache over its slice of the mapping, so
+ * its meshes are uploaded straight from the archive without reading
+ * or even checking the model files.
+ *
+ * The file starts with a header pointing at the table of contents,
+ * which is written after the caches so they can be streamed out one
+ * model at a time. Every cache starts at a multiple of alignment.
+ */
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <cstdint>
+
+#include "MeshCache.h"
+#include "MappedFile.h"
+
+class MeshArchive
+{
+	public:
+		/**
+		 * Writes an archive. Each model is added by writing its cache to
+		 * the stream returned by beginModel() and calling endModel() with
+		 * whether that succeeded.
+		 */
+		class Writer
+		{
+			public:
+				Writer(const std::string &path);
+				std::ostream& beginModel(const std::string &name);
+				void endModel(bool written);
+				bool finish();
+
+			private:
+				struct Entry
+				{
+					std::string name;
+					uint64_t offset;
+					uint64_t size;
+				};
+
+				std::string path;
+				std::string tempPath;
+				std::ofstream out;
+				std::vector<Entry> entries;
+		};
+
+		static const uint64_t alignment = 64;
+
+		MeshArchive(const std::string &path);
+		MeshArchive(const MeshArchive&) = delete;
+		MeshArchive& operator=(const MeshArchive&) = delete;
+
+		bool isOpen() const;
+		const std::vector<std::string>& getNames() const;
+		MeshCache* open(const std::string &path, uint64_t importFlags) const;
+
+	private:
+		static const uint32_t version = 1;
+
+		struct Slice
+		{
+			const char* data;
+			size_t size;
+		};
+
+		MappedFile file;
+		bool valid;
+		std::vector<std::string> names;
+		std::unordered_map<std::string, Slice> slices;
+};
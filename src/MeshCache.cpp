@@ -0,0 +1,337 @@
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <cstring>
+
+#include "MeshCache.h"
+#include "Hash.h"
+
+namespace
+{
+	const char magic[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+	const uint64_t alignment = 16;
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t meshCount;
+		uint64_t sourceHash;
+		int64_t sourceTime;
+		uint64_t sourceSize;
+		uint64_t importFlags;
+	};
+
+	struct MeshEntry
+	{
+		uint64_t vertexOffset;
+		uint64_t vertexCount;
+		uint64_t indexOffset;
+		uint64_t indexCount;
+		uint64_t lodIndexOffset;
+		uint64_t lodIndexCount;
+		uint64_t lodOffset;
+		uint64_t lodCount;
+		uint64_t meshletOffset;
+		uint64_t meshletCount;
+		uint64_t closed;
+		Bounds bounds;
+	};
+
+	uint64_t align(uint64_t offset)
+	{
+		return (offset + alignment - 1) & ~(alignment - 1);
+	}
+
+	/**
+	 * True if count elements of elementSize bytes starting at offset lie
+	 * within size bytes and start at a multiple of the alignment. Checked
+	 * such that corrupt values can't overflow.
+	 */
+	bool fits(uint64_t offset, uint64_t count, size_t elementSize, size_t size)
+	{
+		return offset % alignment == 0 && offset <= size && count <= (size - offset) / elementSize;
+	}
+
+	/**
+	 * True if every range (a Lod or a Meshlet) lies within indexCount indices.
+	 */
+	template <typename Range>
+	bool rangesFit(const Range* ranges, uint64_t count, uint64_t indexCount)
+	{
+		for (uint64_t i = 0; i < count; i++)
+		{
+			if (ranges[i].firstIndex > indexCount || ranges[i].indexCount > indexCount - ranges[i].firstIndex)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * True if every index refers to one of vertexCount vertices.
+	 */
+	bool indicesFit(const unsigned int* indices, uint64_t count, uint64_t vertexCount)
+	{
+		for (uint64_t i = 0; i < count; i++)
+		{
+			if (indices[i] >= vertexCount)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+MeshCache::MeshCache(const std::string &sourcePath, uint64_t importFlags) :
+	validKey(false), checkSource(true), cachePath(sourcePath + ".meshcache"), file(nullptr),
+	image(nullptr), imageSize(0)
+{
+	namespace fs = std::filesystem;
+
+	MappedFile source(sourcePath);
+	std::error_code error;
+	auto time = fs::last_write_time(sourcePath, error);
+	if (!source.isOpen() || error)
+	{
+		return;
+	}
+
+	key.sourceHash = hash(source.data(), source.size());
+	key.sourceTime = time.time_since_epoch().count();
+	key.sourceSize = source.size();
+	key.importFlags = importFlags;
+	validKey = true;
+}
+
+/**
+ * Reads the cache from memory that stays valid for as long as this object
+ * and the meshes taken from it are used. It can't be stored.
+ */
+MeshCache::MeshCache(const char* data, size_t size, uint64_t importFlags) :
+	validKey(true), checkSource(false), file(nullptr), image(data), imageSize(size)
+{
+	key = {};
+	key.importFlags = importFlags;
+}
+
+MeshCache::~MeshCache()
+{
+	delete file;
+}
+
+/**
+ * Maps the cache file and validates it against the source. On success the
+ * meshes are available from getMeshes() for as long as this object lives.
+ */
+bool MeshCache::load()
+{
+	if (!validKey)
+	{
+		return false;
+	}
+
+	if (image)
+	{
+		return parse(image, imageSize);
+	}
+
+	MappedFile* mapped = new MappedFile(cachePath);
+	if (!mapped->isOpen() || !parse(mapped->data(), mapped->size()))
+	{
+		delete mapped;
+		return false;
+	}
+
+	delete file;
+	file = mapped;
+	return true;
+}
+
+/**
+ * Validates the cache at data and points the meshes into it.
+ */
+bool MeshCache::parse(const char* data, size_t size)
+{
+	// Offsets are relative to data, which must be aligned for them to be.
+	const Header* header = reinterpret_cast<const Header*>(data);
+	bool valid = reinterpret_cast<uintptr_t>(data) % alignment == 0 && size >= sizeof(Header) &&
+		memcmp(header->magic, magic, sizeof(magic)) == 0 &&
+		header->version == version &&
+		(!checkSource || (header->sourceHash == key.sourceHash &&
+			header->sourceTime == key.sourceTime &&
+			header->sourceSize == key.sourceSize)) &&
+		header->importFlags == key.importFlags &&
+		header->meshCount <= (size - sizeof(Header)) / sizeof(MeshEntry);
+
+	std::vector<MeshView> views;
+	if (valid)
+	{
+		const MeshEntry* entries = reinterpret_cast<const MeshEntry*>(data + sizeof(Header));
+		for (uint32_t i = 0; i < header->meshCount && valid; i++)
+		{
+			const MeshEntry &entry = entries[i];
+			valid = fits(entry.vertexOffset, entry.vertexCount, sizeof(Vertex), size) &&
+				fits(entry.indexOffset, entry.indexCount, sizeof(unsigned int), size) &&
+				fits(entry.lodIndexOffset, entry.lodIndexCount, sizeof(unsigned int), size) &&
+				fits(entry.lodOffset, entry.lodCount, sizeof(Mesh::Lod), size) &&
+				fits(entry.meshletOffset, entry.meshletCount, sizeof(MeshOptimizer::Meshlet), size);
+			if (!valid)
+			{
+				break;
+			}
+
+			// The contents are drawn as is, so a corrupt cache must not index out of bounds.
+			const unsigned int* indices = reinterpret_cast<const unsigned int*>(data + entry.indexOffset);
+			const unsigned int* lodIndices = reinterpret_cast<const unsigned int*>(data + entry.lodIndexOffset);
+			const Mesh::Lod* lods = reinterpret_cast<const Mesh::Lod*>(data + entry.lodOffset);
+			const MeshOptimizer::Meshlet* meshlets = reinterpret_cast<const MeshOptimizer::Meshlet*>(data + entry.meshletOffset);
+			valid = rangesFit(lods, entry.lodCount, entry.lodIndexCount) &&
+				rangesFit(meshlets, entry.meshletCount, entry.indexCount) &&
+				indicesFit(indices, entry.indexCount, entry.vertexCount) &&
+				indicesFit(lodIndices, entry.lodIndexCount, entry.vertexCount);
+			if (!valid)
+			{
+				break;
+			}
+
+			views.push_back({
+				reinterpret_cast<const Vertex*>(data + entry.vertexOffset), entry.vertexCount,
+				indices, entry.indexCount,
+				lodIndices, entry.lodIndexCount,
+				lods, entry.lodCount,
+				meshlets, entry.meshletCount,
+				entry.closed != 0,
+				entry.bounds
+			});
+		}
+	}
+
+	if (!valid)
+	{
+		return false;
+	}
+
+	meshes = std::move(views);
+	return true;
+}
+
+/**
+ * Writes the meshes to the cache file. The file is written under a temporary
+ * name and renamed so a concurrent reader never sees a partial cache.
+ */
+bool MeshCache::store(const std::vector<Mesh*> &meshes) const
+{
+	if (!validKey || cachePath.empty())
+	{
+		return false;
+	}
+
+	std::string tempPath = cachePath + ".tmp";
+	std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+	bool written = write(out, meshes);
+	out.close();
+	written = written && bool(out);
+	std::error_code error;
+	if (written)
+	{
+		std::filesystem::rename(tempPath, cachePath, error);
+	}
+
+	if (!written || error)
+	{
+		std::cerr << "Could not write mesh cache " << cachePath << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Writes the cache to out, which must be positioned at a multiple of the
+ * alignment, e.g. when writing into a MeshArchive. Returns false if the
+ * source could not be read.
+ */
+bool MeshCache::write(std::ostream &out, const std::vector<Mesh*> &meshes) const
+{
+	if (!validKey)
+	{
+		return false;
+	}
+
+	const uint64_t start = out.tellp();
+	Header header = {};
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.meshCount = meshes.size();
+	header.sourceHash = key.sourceHash;
+	header.sourceTime = key.sourceTime;
+	header.sourceSize = key.sourceSize;
+	header.importFlags = key.importFlags;
+
+	// Lay out the data after the header and the table of entries.
+	std::vector<MeshEntry> entries;
+	uint64_t offset = align(sizeof(Header) + meshes.size() * sizeof(MeshEntry));
+	for (auto mesh : meshes)
+	{
+		MeshEntry entry;
+		entry.vertexOffset = offset;
+		entry.vertexCount = mesh->getVertexCount();
+		offset = align(offset + entry.vertexCount * sizeof(Vertex));
+		entry.indexOffset = offset;
+		entry.indexCount = mesh->getIndexCount();
+		offset = align(offset + entry.indexCount * sizeof(unsigned int));
+		entry.lodIndexOffset = offset;
+		entry.lodIndexCount = mesh->getLodIndexCount();
+		offset = align(offset + entry.lodIndexCount * sizeof(unsigned int));
+		entry.lodOffset = offset;
+		entry.lodCount = mesh->getLodCount();
+		offset = align(offset + entry.lodCount * sizeof(Mesh::Lod));
+		entry.meshletOffset = offset;
+		entry.meshletCount = mesh->getMeshletCount();
+		entry.closed = mesh->isClosed();
+		offset = align(offset + entry.meshletCount * sizeof(MeshOptimizer::Meshlet));
+		entry.bounds = mesh->getBounds();
+		entries.push_back(entry);
+	}
+
+	auto pad = [&out, start] {
+		static const char zeros[alignment] = {};
+		uint64_t offset = uint64_t(out.tellp()) - start;
+		out.write(zeros, align(offset) - offset);
+	};
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshEntry));
+	pad();
+	for (auto mesh : meshes)
+	{
+		out.write(reinterpret_cast<const char*>(mesh->getVertexData()), mesh->getVertexCount() * sizeof(Vertex));
+		pad();
+		out.write(reinterpret_cast<const char*>(mesh->getIndexData()), mesh->getIndexCount() * sizeof(unsigned int));
+		pad();
+		out.write(reinterpret_cast<const char*>(mesh->getLodIndexData()), mesh->getLodIndexCount() * sizeof(unsigned int));
+		pad();
+		out.write(reinterpret_cast<const char*>(mesh->getLodData()), mesh->getLodCount() * sizeof(Mesh::Lod));
+		pad();
+		out.write(reinterpret_cast<const char*>(mesh->getMeshletData()), mesh->getMeshletCount() * sizeof(MeshOptimizer::Meshlet));
+		pad();
+	}
+	return bool(out);
+}
+
+const std::vector<MeshCache::MeshView>& MeshCache::getMeshes() const
+{
+	return meshes;
+}
+
+/**
+ * Size of the cache file mapped by load(). A cache in memory maps nothing
+ * itself, its memory belongs to someone else.
+ */
+size_t MeshCache::getMappedSize() const
+{
+	return file ? file->size() : 0;
+}
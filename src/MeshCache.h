@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+ * Binary cache of the meshes extracted from a model file. The cache
+ * is memory mapped on load so the mesh data can be uploaded straight
+ * from the mapped pages without parsing or copying it.
+ *
+ * The cache is only used if it was written by the same version of
+ * this format, from a source file with the same hash, modification
+ * time and size, and imported with the same flags. The flags hold
+ * the post processing flags and any other setting that changes the
+ * imported meshes.
+ *
+ * A cache can also be read from memory, such as a slice of a mapped
+ * MeshArchive. Such a cache is a snapshot: only its version and
+ * flags are checked, the source file isn't opened at all.
+ */
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+#include "Vertex.h"
+#include "Mesh.h"
+#include "MappedFile.h"
+
+class MeshCache
+{
+	public:
+		/**
+		 * Mesh data that points into the mapped cache file.
+		 */
+		struct MeshView
+		{
+			const Vertex* vertices;
+			size_t vertexCount;
+			const unsigned int* indices;
+			size_t indexCount;
+			const unsigned int* lodIndices;
+			size_t lodIndexCount;
+			const Mesh::Lod* lods;
+			size_t lodCount;
+			const MeshOptimizer::Meshlet* meshlets;
+			size_t meshletCount;
+			bool closed;			// see Mesh::isClosed()
+			Bounds bounds;
+		};
+
+		MeshCache(const std::string &sourcePath, uint64_t importFlags);
+		MeshCache(const char* data, size_t size, uint64_t importFlags);
+		~MeshCache();
+		bool load();
+		bool store(const std::vector<Mesh*> &meshes) const;
+		bool write(std::ostream &out, const std::vector<Mesh*> &meshes) const;
+		const std::vector<MeshView>& getMeshes() const;
+		size_t getMappedSize() const;
+
+	private:
+		static const uint32_t version = 6;
+
+		struct Key
+		{
+			uint64_t sourceHash;
+			int64_t sourceTime;
+			uint64_t sourceSize;
+			uint64_t importFlags;
+		} key;
+		bool validKey;
+		bool checkSource;			// false for a cache in memory, see above
+
+		std::string cachePath;
+		MappedFile* file;
+		const char* image;			// the cache in memory, not owned
+		size_t imageSize;
+		std::vector<MeshView> meshes;
+
+		bool parse(const char* data, size_t size);
+};
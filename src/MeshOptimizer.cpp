@@ -0,0 +1,1142 @@
+#include <unordered_map>
+#include <deque>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <glm/glm.hpp>
+
+#include "MeshOptimizer.h"
+
+namespace
+{
+	const unsigned int unused = std::numeric_limits<unsigned int>::max();
+	const int overdrawResolution = 256;
+	const float meshletConeWeight = 2.0f;	// new vertices a normal 90 degrees off the meshlet's is worth
+
+	/**
+	 * Hashes and compares vertices by their bytes so only bit identical
+	 * vertices are welded.
+	 */
+	struct VertexBits
+	{
+		size_t operator()(const Vertex &vertex) const
+		{
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+			size_t h = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); i++)
+			{
+				h = (h ^ bytes[i]) * 1099511628211ull;
+			}
+			return h;
+		}
+
+		bool operator()(const Vertex &a, const Vertex &b) const
+		{
+			return memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	/**
+	 * Simulates a FIFO cache using the time each vertex entered it.
+	 * Returns how many of the triangle's vertices missed the cache.
+	 */
+	unsigned int updateCache(const unsigned int* triangle, std::vector<unsigned int> &cacheTime,
+			unsigned int &time)
+	{
+		unsigned int misses = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			unsigned int v = triangle[j];
+			if (time - cacheTime[v] > MeshOptimizer::cacheSize)
+			{
+				cacheTime[v] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+	/**
+	 * Rasterizes the triangles in order into a depth buffer, looking along
+	 * one axis of the mesh's bounding box. Counts the pixels covered and the
+	 * fragments that passed the depth test, i.e. would have been shaded.
+	 */
+	void rasterize(const Vertex* vertices, const unsigned int* indices, size_t indexCount,
+			const glm::vec3 &minimum, const glm::vec3 &extent, int axis, bool flip,
+			size_t &covered, size_t &shaded)
+	{
+		const int u = (axis + 1) % 3;
+		const int v = (axis + 2) % 3;
+		const float scale = overdrawResolution - 1;
+		std::vector<float> depth(overdrawResolution * overdrawResolution, std::numeric_limits<float>::max());
+
+		auto project = [&](const glm::vec3 &p) {
+			glm::vec3 n = (p - minimum) / glm::max(extent, glm::vec3(1e-12f));
+			float z = flip ? 1.0f - n[axis] : n[axis];
+			return glm::vec3(n[u] * scale, n[v] * scale, z);
+		};
+
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			glm::vec3 a = project(vertices[indices[i]].position);
+			glm::vec3 b = project(vertices[indices[i + 1]].position);
+			glm::vec3 c = project(vertices[indices[i + 2]].position);
+
+			float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (area == 0.0f)
+			{
+				continue;
+			}
+
+			int minX = std::max(0, int(std::ceil(std::min({ a.x, b.x, c.x }))));
+			int maxX = std::min(overdrawResolution - 1, int(std::floor(std::max({ a.x, b.x, c.x }))));
+			int minY = std::max(0, int(std::ceil(std::min({ a.y, b.y, c.y }))));
+			int maxY = std::min(overdrawResolution - 1, int(std::floor(std::max({ a.y, b.y, c.y }))));
+
+			// Both windings are drawn, the renderer does not cull back faces.
+			for (int y = minY; y <= maxY; y++)
+			{
+				for (int x = minX; x <= maxX; x++)
+				{
+					float w0 = ((c.x - b.x) * (y - b.y) - (c.y - b.y) * (x - b.x)) / area;
+					float w1 = ((a.x - c.x) * (y - c.y) - (a.y - c.y) * (x - c.x)) / area;
+					float w2 = 1.0f - w0 - w1;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+					{
+						continue;
+					}
+
+					float z = w0 * a.z + w1 * b.z + w2 * c.z;
+					float &stored = depth[y * overdrawResolution + x];
+					if (z < stored)
+					{
+						if (stored == std::numeric_limits<float>::max())
+						{
+							covered++;
+						}
+						stored = z;
+						shaded++;
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * Symmetric 4x4 matrix of the squared distances to a set of planes,
+	 * weighted by w so the error is an average squared distance.
+	 */
+	struct Quadric
+	{
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+		double w;
+	};
+
+	void addPlane(Quadric &q, const glm::vec3 &normal, float distance, float weight)
+	{
+		double x = normal.x, y = normal.y, z = normal.z, d = distance;
+		q.a00 += weight * x * x;
+		q.a11 += weight * y * y;
+		q.a22 += weight * z * z;
+		q.a01 += weight * x * y;
+		q.a02 += weight * x * z;
+		q.a12 += weight * y * z;
+		q.b0 += weight * x * d;
+		q.b1 += weight * y * d;
+		q.b2 += weight * z * d;
+		q.c += weight * d * d;
+		q.w += weight;
+	}
+
+	void addQuadric(Quadric &q, const Quadric &other)
+	{
+		q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+		q.a01 += other.a01; q.a02 += other.a02; q.a12 += other.a12;
+		q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+		q.c += other.c;
+		q.w += other.w;
+	}
+
+	double quadricError(const Quadric &q, const glm::vec3 &p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+			+ 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+			+ 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+		return q.w > 0.0 ? std::abs(r) / q.w : 0.0;
+	}
+
+	/**
+	 * Hashes and compares positions by their bits, to find the vertices
+	 * that only differ by their normal.
+	 */
+	struct PositionBits
+	{
+		size_t operator()(const glm::vec3 &p) const
+		{
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+
+		bool operator()(const glm::vec3 &a, const glm::vec3 &b) const
+		{
+			return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+		}
+	};
+
+	/**
+	 * How a vertex may move during simplification.
+	 *	Manifold: Inside a surface, may collapse onto any neighbour.
+	 *	Border: On an open edge, may only slide along it.
+	 *	Seam: On a normal seam, may only slide along the seam, and the
+	 *	      vertex on the other side of the seam slides with it.
+	 *	Locked: Never moves.
+	 */
+	enum VertexKind
+	{
+		Manifold,
+		Border,
+		Seam,
+		Locked
+	};
+
+	const unsigned int multiple = unused - 1;
+
+	/**
+	 * Remembers the other end of the one open edge leaving or entering a
+	 * vertex, or multiple if there is more than one.
+	 */
+	void recordOpenEdge(unsigned int &slot, unsigned int vertex)
+	{
+		slot = slot == unused ? vertex : multiple;
+	}
+
+	bool isSingle(unsigned int slot)
+	{
+		return slot != unused && slot != multiple;
+	}
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double error;
+	};
+}
+
+/**
+ * Simulates a FIFO post transform cache while drawing the triangles in order,
+ * and measures the overdraw.
+ */
+MeshOptimizer::Statistics MeshOptimizer::analyze(const Vertex* vertices, size_t vertexCount,
+		const unsigned int* indices, size_t indexCount)
+{
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	size_t misses = 0;
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		misses += updateCache(indices + i, cacheTime, time);
+	}
+
+	size_t covered = 0, shaded = 0;
+	if (vertexCount > 0)
+	{
+		glm::vec3 minimum = vertices[0].position;
+		glm::vec3 maximum = minimum;
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			minimum = glm::min(minimum, vertices[i].position);
+			maximum = glm::max(maximum, vertices[i].position);
+		}
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			rasterize(vertices, indices, indexCount, minimum, maximum - minimum, axis, false, covered, shaded);
+			rasterize(vertices, indices, indexCount, minimum, maximum - minimum, axis, true, covered, shaded);
+		}
+	}
+
+	Statistics statistics = {};
+	statistics.add({ vertexCount, indexCount / 3, misses, covered, shaded, 0.0f, 0.0f, 0.0f });
+	return statistics;
+}
+
+/**
+ * Accumulates the statistics of another mesh, e.g. to report a whole model.
+ */
+void MeshOptimizer::Statistics::add(const Statistics &other)
+{
+	vertexCount += other.vertexCount;
+	triangleCount += other.triangleCount;
+	cacheMisses += other.cacheMisses;
+	pixelsCovered += other.pixelsCovered;
+	pixelsShaded += other.pixelsShaded;
+	acmr = triangleCount ? float(cacheMisses) / triangleCount : 0.0f;
+	atvr = vertexCount ? float(cacheMisses) / vertexCount : 0.0f;
+	overdraw = pixelsCovered ? float(pixelsShaded) / pixelsCovered : 0.0f;
+}
+
+/**
+ * Merges vertices whose data is bit for bit identical and remaps the indices.
+ */
+void MeshOptimizer::weldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+	std::unordered_map<Vertex, unsigned int, VertexBits, VertexBits> unique;
+	unique.reserve(vertices.size());
+
+	std::vector<unsigned int> remap(vertices.size());
+	std::vector<Vertex> welded;
+	welded.reserve(vertices.size());
+
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		auto inserted = unique.emplace(vertices[i], welded.size());
+		if (inserted.second)
+		{
+			welded.push_back(vertices[i]);
+		}
+		remap[i] = inserted.first->second;
+	}
+
+	for (auto &index : indices)
+	{
+		index = remap[index];
+	}
+	vertices = std::move(welded);
+}
+
+/**
+ * Reorders the triangles with Tipsify (Sander, Nehab and Barczak, "Fast
+ * Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007).
+ * Triangles are emitted as fans around a vertex, and the next fan vertex
+ * is picked among the ones just emitted that will still be in the cache.
+ */
+void MeshOptimizer::optimizeVertexCache(size_t vertexCount, std::vector<unsigned int> &indices)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Triangles using each vertex, as offsets into one array.
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (auto index : indices)
+	{
+		liveTriangles[index]++;
+	}
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (size_t j = 0; j < 3; j++)
+		{
+			adjacency[fill[indices[3 * t + j]]++] = t;
+		}
+	}
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnds;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+
+	unsigned int time = cacheSize + 1;
+	size_t cursor = 0;
+	long fan = indices[0];
+
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (unsigned int a = adjacencyOffsets[fan]; a < adjacencyOffsets[fan + 1]; a++)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+			{
+				continue;
+			}
+
+			for (size_t j = 0; j < 3; j++)
+			{
+				unsigned int v = indices[3 * t + j];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = time++;
+				}
+			}
+			emitted[t] = true;
+		}
+
+		// Prefer the candidate that entered the cache earliest and is
+		// still guaranteed to be in it after its remaining fan is emitted.
+		fan = -1;
+		long best = -1;
+		for (auto v : candidates)
+		{
+			if (liveTriangles[v] == 0)
+			{
+				continue;
+			}
+
+			long priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+			{
+				priority = time - cacheTime[v];
+			}
+			if (priority > best)
+			{
+				best = priority;
+				fan = v;
+			}
+		}
+
+		// Dead end, go back to a recently used vertex or scan for any vertex
+		// with triangles left.
+		while (fan < 0 && !deadEnds.empty())
+		{
+			unsigned int v = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[v] > 0)
+			{
+				fan = v;
+			}
+		}
+		while (fan < 0 && cursor < vertexCount)
+		{
+			if (liveTriangles[cursor] > 0)
+			{
+				fan = cursor;
+			}
+			cursor++;
+		}
+	}
+
+	indices = std::move(output);
+}
+
+/**
+ * Reorders the triangles so that clusters facing outwards are drawn first,
+ * which lets the depth test reject most of the fragments behind them from
+ * any view. Follows the second half of Tipsify: triangles that were ordered
+ * for the vertex cache are split into clusters wherever the cache starts
+ * cold, and those are split further as long as each piece keeps its cache
+ * miss ratio within threshold times the ratio of the whole cluster. A
+ * threshold of 1 keeps the vertex cache efficiency, larger values trade it
+ * for smaller clusters and less overdraw.
+ */
+void MeshOptimizer::optimizeOverdraw(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+		float threshold)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Hard boundaries, where all three vertices of a triangle miss the cache.
+	std::vector<unsigned int> cacheTime(vertices.size(), 0);
+	unsigned int time = cacheSize + 1;
+	std::vector<size_t> hardBoundaries;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (updateCache(&indices[3 * t], cacheTime, time) == 3 || t == 0)
+		{
+			hardBoundaries.push_back(t);
+		}
+	}
+	hardBoundaries.push_back(triangleCount);
+
+	// Soft boundaries inside each hard cluster.
+	std::vector<size_t> boundaries;
+	for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+	{
+		size_t start = hardBoundaries[h];
+		size_t end = hardBoundaries[h + 1];
+
+		time += cacheSize + 1;
+		size_t clusterMisses = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			clusterMisses += updateCache(&indices[3 * t], cacheTime, time);
+		}
+		const float clusterThreshold = threshold * float(clusterMisses) / float(end - start);
+
+		boundaries.push_back(start);
+		time += cacheSize + 1;
+		size_t misses = 0, count = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			misses += updateCache(&indices[3 * t], cacheTime, time);
+			count++;
+			if (float(misses) / float(count) <= clusterThreshold && t + 1 < end)
+			{
+				boundaries.push_back(t + 1);
+				time += cacheSize + 1;
+				misses = 0;
+				count = 0;
+			}
+		}
+	}
+	boundaries.push_back(triangleCount);
+
+	// Sort the clusters by how far they face away from the mesh's centroid.
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	std::vector<float> sortKeys;
+	std::vector<glm::vec3> clusterCentroids, clusterNormals;
+	for (size_t c = 0; c + 1 < boundaries.size(); c++)
+	{
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = boundaries[c]; t < boundaries[c + 1]; t++)
+		{
+			const glm::vec3 &p0 = vertices[indices[3 * t]].position;
+			const glm::vec3 &p1 = vertices[indices[3 * t + 1]].position;
+			const glm::vec3 &p2 = vertices[indices[3 * t + 2]].position;
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+			float triangleArea = glm::length(cross);
+
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+		meshCentroid += centroid;
+		meshArea += area;
+		clusterCentroids.push_back(area > 0.0f ? centroid / area : centroid);
+		float length = glm::length(normal);
+		clusterNormals.push_back(length > 0.0f ? normal / length : normal);
+	}
+	if (meshArea > 0.0f)
+	{
+		meshCentroid /= meshArea;
+	}
+	for (size_t c = 0; c < clusterCentroids.size(); c++)
+	{
+		sortKeys.push_back(glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]));
+	}
+
+	std::vector<size_t> order(sortKeys.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<unsigned int> sorted;
+	sorted.reserve(indices.size());
+	for (auto c : order)
+	{
+		sorted.insert(sorted.end(), indices.begin() + 3 * boundaries[c], indices.begin() + 3 * boundaries[c + 1]);
+	}
+	indices = std::move(sorted);
+}
+
+/**
+ * Reorders the vertices in the order the triangles first use them so vertex
+ * fetches walk through memory linearly. Unreferenced vertices are dropped.
+ */
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+	std::vector<unsigned int> remap(vertices.size(), unused);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (auto &index : indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(reordered);
+}
+
+/**
+ * Cuts the mesh into chunks that each use at most maxVertices vertices, in
+ * triangle order, so every chunk can be drawn with smaller indices. Vertices
+ * used on both sides of a cut are copied into each chunk.
+ */
+std::vector<MeshOptimizer::Chunk> MeshOptimizer::splitMesh(const Vertex* vertices, size_t vertexCount,
+		const unsigned int* indices, size_t indexCount, size_t maxVertices)
+{
+	std::vector<Chunk> chunks;
+	std::vector<unsigned int> remap(vertexCount, unused);
+	std::vector<unsigned int> used;		// vertices remapped in the current chunk
+
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		size_t added = 0;
+		for (size_t k = 0; k < 3; k++)
+		{
+			added += remap[indices[t + k]] == unused ? 1 : 0;
+		}
+
+		if (chunks.empty() || chunks.back().vertices.size() + added > maxVertices)
+		{
+			for (auto vertex : used)
+			{
+				remap[vertex] = unused;
+			}
+			used.clear();
+			chunks.emplace_back();
+		}
+
+		Chunk &chunk = chunks.back();
+		for (size_t k = 0; k < 3; k++)
+		{
+			unsigned int index = indices[t + k];
+			if (remap[index] == unused)
+			{
+				remap[index] = chunk.vertices.size();
+				chunk.vertices.push_back(vertices[index]);
+				used.push_back(index);
+			}
+			chunk.indices.push_back(remap[index]);
+		}
+	}
+	return chunks;
+}
+
+/**
+ * Reduces the triangles to about targetIndexCount indices by collapsing
+ * edges in the order of the least quadric error (Garland and Heckbert,
+ * "Surface Simplification Using Quadric Error Metrics", 1997). Vertices
+ * always collapse onto an existing vertex, so the result indexes the same
+ * vertices. Open borders and normal seams only collapse along themselves
+ * so they keep their shape. error is set to the largest distance, in model
+ * units, between the simplified and the original surface.
+ */
+std::vector<unsigned int> MeshOptimizer::simplify(const std::vector<Vertex> &vertices,
+		const std::vector<unsigned int> &indices, size_t targetIndexCount, float &error)
+{
+	const size_t vertexCount = vertices.size();
+	const float edgeWeight = 10.0f;
+	std::vector<unsigned int> result(indices.begin(), indices.end() - indices.size() % 3);
+	error = 0.0f;
+
+	// Vertices at the same position, linked in a circular list by wedge.
+	std::unordered_map<glm::vec3, unsigned int, PositionBits, PositionBits> positions;
+	std::vector<unsigned int> remap(vertexCount), wedge(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		remap[v] = positions.emplace(vertices[v].position, v).first->second;
+		wedge[v] = v;
+		if (remap[v] != v)
+		{
+			wedge[v] = wedge[remap[v]];
+			wedge[remap[v]] = v;
+		}
+	}
+
+	// An edge is open if no triangle uses it in the opposite direction.
+	std::unordered_map<uint64_t, unsigned int> edges;
+	auto edgeKey = [](unsigned int a, unsigned int b) { return uint64_t(a) << 32 | b; };
+	for (size_t i = 0; i < result.size(); i++)
+	{
+		unsigned int a = result[i], b = result[i - i % 3 + (i + 1) % 3];
+		edges[edgeKey(a, b)]++;
+	}
+	std::vector<unsigned int> openOut(vertexCount, unused), openIn(vertexCount, unused);
+	for (size_t i = 0; i < result.size(); i++)
+	{
+		unsigned int a = result[i], b = result[i - i % 3 + (i + 1) % 3];
+		if (edges.find(edgeKey(b, a)) == edges.end())
+		{
+			recordOpenEdge(openOut[a], b);
+			recordOpenEdge(openIn[b], a);
+		}
+	}
+
+	std::vector<VertexKind> kinds(vertexCount, Locked);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		unsigned int w = wedge[v];
+		if (w == v)
+		{
+			if (openOut[v] == unused && openIn[v] == unused)
+			{
+				kinds[v] = Manifold;
+			}
+			else if (isSingle(openOut[v]) && isSingle(openIn[v]))
+			{
+				kinds[v] = Border;
+			}
+		}
+		else if (wedge[w] == v && isSingle(openOut[v]) && isSingle(openIn[v]) &&
+				isSingle(openOut[w]) && isSingle(openIn[w]) &&
+				remap[openOut[v]] == remap[openIn[w]] && remap[openIn[v]] == remap[openOut[w]])
+		{
+			kinds[v] = Seam;
+		}
+	}
+
+	// Each position gets the planes of its triangles, weighted by area, and
+	// planes perpendicular to its open edges so borders and seams stay put.
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+	for (size_t t = 0; t < result.size(); t += 3)
+	{
+		const glm::vec3 &p0 = vertices[result[t]].position;
+		const glm::vec3 &p1 = vertices[result[t + 1]].position;
+		const glm::vec3 &p2 = vertices[result[t + 2]].position;
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float area = glm::length(normal);
+		if (area == 0.0f)
+		{
+			continue;
+		}
+		normal /= area;
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			addPlane(quadrics[remap[result[t + k]]], normal, -glm::dot(normal, p0), area);
+		}
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			unsigned int a = result[t + k], b = result[t + (k + 1) % 3];
+			if (edges.find(edgeKey(b, a)) != edges.end())
+			{
+				continue;
+			}
+			const glm::vec3 &pa = vertices[a].position;
+			glm::vec3 edge = vertices[b].position - pa;
+			glm::vec3 edgeNormal = glm::cross(edge, normal);
+			float length = glm::length(edgeNormal);
+			if (length == 0.0f)
+			{
+				continue;
+			}
+			edgeNormal /= length;
+			float weight = glm::dot(edge, edge) * edgeWeight;
+			addPlane(quadrics[remap[a]], edgeNormal, -glm::dot(edgeNormal, pa), weight);
+			addPlane(quadrics[remap[b]], edgeNormal, -glm::dot(edgeNormal, pa), weight);
+		}
+	}
+
+	// Where the vertex on the other side of a seam has to collapse to.
+	auto seamTarget = [&](unsigned int from, unsigned int to) {
+		unsigned int w = wedge[from];
+		if (isSingle(openOut[w]) && remap[openOut[w]] == remap[to])
+		{
+			return openOut[w];
+		}
+		if (isSingle(openIn[w]) && remap[openIn[w]] == remap[to])
+		{
+			return openIn[w];
+		}
+		return unused;
+	};
+
+	auto canCollapse = [&](unsigned int from, unsigned int to) {
+		VertexKind kind = kinds[from];
+		if (kind == Manifold)
+		{
+			return true;
+		}
+		if (kind == Locked || (to != openOut[from] && to != openIn[from]))
+		{
+			return false;
+		}
+		if (kind == Border)
+		{
+			return kinds[to] == Border || kinds[to] == Locked;
+		}
+		return (kinds[to] == Seam || kinds[to] == Locked) && seamTarget(from, to) != unused;
+	};
+
+	std::vector<unsigned int> adjacencyOffsets, adjacency;
+	std::vector<unsigned int> collapseRemap(vertexCount);
+	std::vector<char> touched(vertexCount);
+	std::vector<Collapse> collapses;
+
+	while (result.size() > targetIndexCount)
+	{
+		// Triangles around every position.
+		adjacencyOffsets.assign(vertexCount + 1, 0);
+		for (auto index : result)
+		{
+			adjacencyOffsets[remap[index] + 1]++;
+		}
+		std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+		adjacency.resize(result.size());
+		std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			adjacency[fill[remap[result[i]]]++] = i / 3;
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			unsigned int a = result[i], b = result[i - i % 3 + (i + 1) % 3];
+			if (remap[a] == remap[b])
+			{
+				continue;
+			}
+			if (canCollapse(a, b))
+			{
+				collapses.push_back({ a, b, quadricError(quadrics[remap[a]], vertices[b].position) });
+			}
+			if (canCollapse(b, a))
+			{
+				collapses.push_back({ b, a, quadricError(quadrics[remap[b]], vertices[a].position) });
+			}
+		}
+		if (collapses.empty())
+		{
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+			return a.error < b.error;
+		});
+
+		// A manifold collapse removes two triangles. Collapses much worse than
+		// the ones needed to reach the target are left for a later pass.
+		size_t goal = (result.size() - targetIndexCount) / 6;
+		double errorLimit = collapses[std::min(goal, collapses.size() - 1)].error * 1.5;
+
+		std::iota(collapseRemap.begin(), collapseRemap.end(), 0);
+		std::fill(touched.begin(), touched.end(), 0);
+		size_t removed = 0;
+
+		for (auto &collapse : collapses)
+		{
+			if (collapse.error > errorLimit || removed >= result.size() - targetIndexCount)
+			{
+				break;
+			}
+			unsigned int from = collapse.from, to = collapse.to;
+			if (touched[remap[from]] || touched[remap[to]])
+			{
+				continue;
+			}
+
+			// Reject collapses that flip a remaining triangle.
+			const glm::vec3 &target = vertices[to].position;
+			bool flips = false;
+			size_t removedTriangles = 0;
+			for (unsigned int j = adjacencyOffsets[remap[from]]; j < adjacencyOffsets[remap[from] + 1] && !flips; j++)
+			{
+				const unsigned int* triangle = &result[3 * adjacency[j]];
+				glm::vec3 p[3];
+				bool degenerate = false;
+				for (size_t k = 0; k < 3; k++)
+				{
+					p[k] = vertices[triangle[k]].position;
+					degenerate = degenerate || remap[triangle[k]] == remap[to];
+				}
+				if (degenerate)
+				{
+					removedTriangles++;
+					continue;
+				}
+
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				for (size_t k = 0; k < 3; k++)
+				{
+					if (remap[triangle[k]] == remap[from])
+					{
+						p[k] = target;
+					}
+				}
+				glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+				flips = glm::dot(before, after) <= 1e-2f * glm::length(before) * glm::length(after);
+			}
+			if (flips)
+			{
+				continue;
+			}
+
+			// Nothing around the collapse may change again in this pass.
+			for (unsigned int j = adjacencyOffsets[remap[from]]; j < adjacencyOffsets[remap[from] + 1]; j++)
+			{
+				for (size_t k = 0; k < 3; k++)
+				{
+					touched[remap[result[3 * adjacency[j] + k]]] = 1;
+				}
+			}
+
+			collapseRemap[from] = to;
+			if (kinds[from] == Seam)
+			{
+				collapseRemap[wedge[from]] = seamTarget(from, to);
+			}
+			addQuadric(quadrics[remap[to]], quadrics[remap[from]]);
+			error = std::max(error, float(collapse.error));
+			removed += 3 * removedTriangles;
+		}
+
+		if (removed == 0)
+		{
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t t = 0; t < result.size(); t += 3)
+		{
+			unsigned int a = collapseRemap[result[t]];
+			unsigned int b = collapseRemap[result[t + 1]];
+			unsigned int c = collapseRemap[result[t + 2]];
+			if (remap[a] != remap[b] && remap[b] != remap[c] && remap[a] != remap[c])
+			{
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+		}
+		result.resize(write);
+	}
+
+	error = std::sqrt(error);
+	return result;
+}
+
+/**
+ * Groups the triangles into meshlets of at most maxVertices vertices and
+ * maxTriangles triangles, and reorders the indices so every meshlet is a
+ * consecutive range. A meshlet grows from the first unused triangle by
+ * adding the neighbouring triangle that adds the fewest new vertices, and
+ * of those the one whose normal is closest to the meshlet's, which keeps
+ * meshlets compact and their normal cones narrow.
+ */
+std::vector<MeshOptimizer::Meshlet> MeshOptimizer::buildMeshlets(const Vertex* vertices, size_t vertexCount,
+		std::vector<unsigned int> &indices, size_t maxVertices, size_t maxTriangles)
+{
+	const size_t triangleCount = indices.size() / 3;
+
+	// Triangles around every position, so triangles on both sides of a hard
+	// edge are neighbours as well.
+	std::unordered_map<glm::vec3, unsigned int, PositionBits, PositionBits> positions;
+	std::vector<unsigned int> remap(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		remap[v] = positions.emplace(vertices[v].position, v).first->second;
+	}
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0), adjacency(triangleCount * 3);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		adjacencyOffsets[remap[indices[i]] + 1]++;
+	}
+	std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+	std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		adjacency[fill[remap[indices[i]]]++] = i / 3;
+	}
+
+	std::vector<glm::vec3> normals(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const glm::vec3 &p0 = vertices[indices[3 * t]].position;
+		glm::vec3 normal = glm::cross(vertices[indices[3 * t + 1]].position - p0, vertices[indices[3 * t + 2]].position - p0);
+		float length = glm::length(normal);
+		normals[t] = length > 0.0f ? normal / length : normal;
+	}
+
+	std::vector<Meshlet> meshlets;
+	std::vector<unsigned int> ordered;
+	ordered.reserve(triangleCount * 3);
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<unsigned int> owner(vertexCount, unused);	// meshlet that last used each vertex
+	std::vector<unsigned int> positionOwner(vertexCount, unused);
+	std::vector<unsigned int> meshletPositions;
+	size_t usedVertices = 0;
+	size_t seed = 0;
+
+	while (true)
+	{
+		while (seed < triangleCount && emitted[seed])
+		{
+			seed++;
+		}
+		if (seed == triangleCount)
+		{
+			break;
+		}
+
+		unsigned int id = meshlets.size();
+		meshlets.push_back({ uint32_t(ordered.size()), 0, glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), 1.0f });
+		meshletPositions.clear();
+		usedVertices = 0;
+		glm::vec3 normalSum(0.0f);
+		size_t next = seed;
+
+		while (next != triangleCount)
+		{
+			emitted[next] = 1;
+			for (size_t k = 0; k < 3; k++)
+			{
+				unsigned int index = indices[3 * next + k];
+				ordered.push_back(index);
+				if (owner[index] != id)
+				{
+					owner[index] = id;
+					usedVertices++;
+				}
+				if (positionOwner[remap[index]] != id)
+				{
+					positionOwner[remap[index]] = id;
+					meshletPositions.push_back(remap[index]);
+				}
+			}
+			meshlets.back().indexCount += 3;
+			normalSum += normals[next];
+
+			if (meshlets.back().indexCount / 3 >= maxTriangles)
+			{
+				break;
+			}
+
+			// Best unused neighbour that still fits.
+			glm::vec3 axis = glm::length(normalSum) > 0.0f ? glm::normalize(normalSum) : normalSum;
+			next = triangleCount;
+			float bestScore = std::numeric_limits<float>::max();
+			for (auto position : meshletPositions)
+			{
+				for (unsigned int j = adjacencyOffsets[position]; j < adjacencyOffsets[position + 1]; j++)
+				{
+					unsigned int t = adjacency[j];
+					if (emitted[t])
+					{
+						continue;
+					}
+					size_t added = 0;
+					for (size_t k = 0; k < 3; k++)
+					{
+						added += owner[indices[3 * t + k]] != id ? 1 : 0;
+					}
+					float score = added + meshletConeWeight * (1.0f - glm::dot(normals[t], axis));
+					if (usedVertices + added <= maxVertices && score < bestScore)
+					{
+						next = t;
+						bestScore = score;
+					}
+				}
+			}
+		}
+	}
+	indices = std::move(ordered);
+
+	for (auto &meshlet : meshlets)
+	{
+		const unsigned int* triangles = indices.data() + meshlet.firstIndex;
+
+		// Sphere around the center of the bounding box.
+		glm::vec3 minimum(std::numeric_limits<float>::max());
+		glm::vec3 maximum(std::numeric_limits<float>::lowest());
+		for (size_t i = 0; i < meshlet.indexCount; i++)
+		{
+			minimum = glm::min(minimum, vertices[triangles[i]].position);
+			maximum = glm::max(maximum, vertices[triangles[i]].position);
+		}
+		meshlet.center = (minimum + maximum) * 0.5f;
+		for (size_t i = 0; i < meshlet.indexCount; i++)
+		{
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[triangles[i]].position - meshlet.center));
+		}
+
+		// Cone around the face normals, from the area weighted average normal.
+		std::vector<glm::vec3> normals;
+		glm::vec3 axis(0.0f);
+		for (size_t i = 0; i < meshlet.indexCount; i += 3)
+		{
+			const glm::vec3 &p0 = vertices[triangles[i]].position;
+			glm::vec3 normal = glm::cross(vertices[triangles[i + 1]].position - p0, vertices[triangles[i + 2]].position - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f)
+			{
+				axis += normal;
+				normals.push_back(normal / length);
+			}
+		}
+		float axisLength = glm::length(axis);
+		if (axisLength == 0.0f)
+		{
+			continue;
+		}
+		meshlet.coneAxis = axis / axisLength;
+
+		float minimumDot = 1.0f;
+		for (auto &normal : normals)
+		{
+			minimumDot = std::min(minimumDot, glm::dot(normal, meshlet.coneAxis));
+		}
+		// Cones wider than about 85 degrees hardly ever cull, they never will.
+		meshlet.coneCutoff = minimumDot <= 0.1f ? 1.0f : std::sqrt(1.0f - minimumDot * minimumDot);
+	}
+	return meshlets;
+}
+
+/**
+ * True if every triangle of the meshlet faces away from the camera, with
+ * the camera in the same space as the meshlet.
+ */
+bool MeshOptimizer::isBackFacing(const Meshlet &meshlet, const glm::vec3 &camera)
+{
+	glm::vec3 toCenter = meshlet.center - camera;
+	return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
+
+/**
+ * True if every edge is used by exactly two triangles, once in each
+ * direction, with vertices compared by position so seams don't count as
+ * openings. Only then are back faces never seen and meshlets facing away
+ * from the camera safe to cull, the renderer draws both windings.
+ */
+bool MeshOptimizer::isClosed(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+{
+	if (indexCount == 0)
+	{
+		return false;
+	}
+
+	std::unordered_map<glm::vec3, unsigned int, PositionBits, PositionBits> positions;
+	std::vector<unsigned int> remap(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		remap[v] = positions.emplace(vertices[v].position, v).first->second;
+	}
+
+	std::unordered_map<uint64_t, unsigned int> edges;
+	auto edgeKey = [](unsigned int a, unsigned int b) { return uint64_t(a) << 32 | b; };
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			unsigned int a = remap[indices[i + j]];
+			unsigned int b = remap[indices[i + (j + 1) % 3]];
+			// Edges of degenerate triangles have no length to see through.
+			if (a != b)
+			{
+				edges[edgeKey(a, b)]++;
+			}
+		}
+	}
+
+	for (auto &edge : edges)
+	{
+		auto opposite = edges.find(edgeKey(edge.first & 0xffffffff, edge.first >> 32));
+		if (edge.second != 1 || opposite == edges.end() || opposite->second != 1)
+		{
+			return false;
+		}
+	}
+	return true;
+}
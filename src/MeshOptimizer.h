@@ -0,0 +1,85 @@
+#pragma once
+
+/*
+ * Reorders and compacts indexed triangle meshes so the GPU runs
+ * the vertex shader, fetches vertex data and shades pixels as
+ * little as possible.
+ */
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+
+class MeshOptimizer
+{
+	public:
+		/**
+		 * How well the post transform vertex cache is used, simulated with
+		 * a FIFO cache of cacheSize entries.
+		 *	acmr: Average cache miss ratio, vertex shader runs per triangle.
+		 *	atvr: Average transformed vertex ratio, vertex shader runs per vertex.
+		 *
+		 * And how often each pixel is shaded, measured by rasterizing the
+		 * mesh in order with a depth test from six axis aligned views.
+		 *	overdraw: Shaded fragments per covered pixel, 1 is ideal.
+		 */
+		struct Statistics
+		{
+			size_t vertexCount;
+			size_t triangleCount;
+			size_t cacheMisses;
+			size_t pixelsCovered;
+			size_t pixelsShaded;
+			float acmr;
+			float atvr;
+			float overdraw;
+
+			void add(const Statistics &other);
+		};
+
+		/**
+		 * Part of a mesh created by splitMesh().
+		 */
+		struct Chunk
+		{
+			std::vector<Vertex> vertices;
+			std::vector<unsigned int> indices;
+		};
+
+		/**
+		 * A small cluster of neighbouring triangles of a mesh.
+		 *	center, radius: Bounding sphere of its vertices.
+		 *	coneAxis, coneCutoff: Normal cone for back face culling, see
+		 *	isBackFacing(). A cutoff of 1 never culls.
+		 */
+		struct Meshlet
+		{
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			glm::vec3 center;
+			float radius;
+			glm::vec3 coneAxis;
+			float coneCutoff;
+		};
+
+		static const unsigned int cacheSize = 16;
+		static const unsigned int meshletVertices = 64;
+		static const unsigned int meshletTriangles = 124;
+
+		static Statistics analyze(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+		static void weldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+		static void optimizeVertexCache(size_t vertexCount, std::vector<unsigned int> &indices);
+		static void optimizeOverdraw(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, float threshold);
+		static void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+		static std::vector<unsigned int> simplify(const std::vector<Vertex> &vertices,
+				const std::vector<unsigned int> &indices, size_t targetIndexCount, float &error);
+		static std::vector<Meshlet> buildMeshlets(const Vertex* vertices, size_t vertexCount,
+				std::vector<unsigned int> &indices, size_t maxVertices, size_t maxTriangles);
+		static bool isBackFacing(const Meshlet &meshlet, const glm::vec3 &camera);
+		static bool isClosed(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+		static std::vector<Chunk> splitMesh(const Vertex* vertices, size_t vertexCount,
+				const unsigned int* indices, size_t indexCount, size_t maxVertices);
+};
@@ -4,36 +4,1070 @@
 #include <assimp/Importer.hpp>      // C++ importer interface
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
 #include <iostream>
+#include <sstream>
+#include <limits>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
 
 #include "Model.h"
+#include "ObjParser.h"
 
-Model::Model(const std::string &objPath, const Shader& shader) :
-	shader(shader), modelMatrix(1.0f), m_rotate(0), m_scale(1), m_translation(0)
+const unsigned int Model::postProcessFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+	using Milliseconds = std::chrono::duration<double, std::milli>;
+
+	/**
+	 * A file opened by TimedIOSystem, adding the time spent reading it.
+	 */
+	class TimedIOStream : public Assimp::IOStream
+	{
+		public:
+			TimedIOStream(Assimp::IOStream* stream, double &milliseconds) :
+				stream(stream), milliseconds(milliseconds)
+			{
+			}
+
+			size_t Read(void* buffer, size_t size, size_t count) override
+			{
+				Clock::time_point start = Clock::now();
+				size_t read = stream->Read(buffer, size, count);
+				milliseconds += Milliseconds(Clock::now() - start).count();
+				return read;
+			}
+
+			size_t Write(const void* buffer, size_t size, size_t count) override
+			{
+				return stream->Write(buffer, size, count);
+			}
+
+			aiReturn Seek(size_t offset, aiOrigin origin) override
+			{
+				return stream->Seek(offset, origin);
+			}
+
+			size_t Tell() const override
+			{
+				return stream->Tell();
+			}
+
+			size_t FileSize() const override
+			{
+				return stream->FileSize();
+			}
+
+			void Flush() override
+			{
+				stream->Flush();
+			}
+
+			Assimp::IOStream* stream;
+
+		private:
+			double &milliseconds;
+	};
+
+	/**
+	 * Assimp's default file system, measuring how long Assimp spends opening
+	 * and reading files so it can be told apart from parsing them.
+	 */
+	class TimedIOSystem : public Assimp::IOSystem
+	{
+		public:
+			TimedIOSystem(double &milliseconds) : milliseconds(milliseconds)
+			{
+			}
+
+			bool Exists(const char* path) const override
+			{
+				return files.Exists(path);
+			}
+
+			char getOsSeparator() const override
+			{
+				return files.getOsSeparator();
+			}
+
+			Assimp::IOStream* Open(const char* path, const char* mode) override
+			{
+				Clock::time_point start = Clock::now();
+				Assimp::IOStream* stream = files.Open(path, mode);
+				milliseconds += Milliseconds(Clock::now() - start).count();
+				return stream ? new TimedIOStream(stream, milliseconds) : nullptr;
+			}
+
+			void Close(Assimp::IOStream* file) override
+			{
+				TimedIOStream* timed = static_cast<TimedIOStream*>(file);
+				files.Close(timed->stream);
+				delete timed;
+			}
+
+		private:
+			Assimp::DefaultIOSystem files;
+			double &milliseconds;
+	};
+
+	/**
+	 * The left, right, bottom, top, near and far planes of the frustum of
+	 * a projection matrix, as (normal, distance) with the normal inwards.
+	 */
+	void extractFrustumPlanes(const glm::mat4 &m, glm::vec4 planes[6])
+	{
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+		{
+			rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			planes[2 * i] = rows[3] + rows[i];
+			planes[2 * i + 1] = rows[3] - rows[i];
+		}
+	}
+
+	/**
+	 * False if the sphere is completely outside one of the planes.
+	 */
+	bool isSphereVisible(const glm::vec4 planes[6], const glm::vec3 &center, float radius)
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 normal(planes[i]);
+			if (glm::dot(normal, center) + planes[i].w < -radius * glm::length(normal))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * False if the box is completely outside one of the planes, tested with
+	 * the corner furthest along each plane's normal.
+	 */
+	bool isBoxVisible(const glm::vec4 planes[6], const glm::vec3 &minimum, const glm::vec3 &maximum)
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 normal(planes[i]);
+			glm::vec3 corner(normal.x >= 0.0f ? maximum.x : minimum.x,
+					normal.y >= 0.0f ? maximum.y : minimum.y,
+					normal.z >= 0.0f ? maximum.z : minimum.z);
+			if (glm::dot(normal, corner) + planes[i].w < 0.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Lists the meshes in the same order extractDataFromNode() visits them.
+	 */
+	void collectMeshes(const aiScene* scene, const aiNode* node, std::vector<const aiMesh*> &out)
+	{
+		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+		{
+			out.push_back(scene->mMeshes[node->mMeshes[i]]);
+		}
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+		{
+			collectMeshes(scene, node->mChildren[i], out);
+		}
+	}
+
+	/**
+	 * True if the parsed meshes match the ones Assimp imported, otherwise
+	 * describes the first difference in message. Positions and indices must
+	 * match exactly, normals may differ by rounding.
+	 */
+	bool compareMeshes(const std::vector<ObjParser::MeshData> &parsed,
+			const std::vector<const aiMesh*> &expected, std::string &message)
+	{
+		const float normalTolerance = 1e-4f;
+		std::ostringstream difference;
+
+		if (parsed.size() != expected.size())
+		{
+			difference << parsed.size() << " meshes, Assimp has " << expected.size();
+			message = difference.str();
+			return false;
+		}
+
+		for (size_t m = 0; m < parsed.size(); m++)
+		{
+			const ObjParser::MeshData &mesh = parsed[m];
+			const aiMesh* reference = expected[m];
+
+			size_t referenceIndexCount = 0;
+			for (unsigned int f = 0; f < reference->mNumFaces; f++)
+			{
+				referenceIndexCount += reference->mFaces[f].mNumIndices;
+			}
+
+			if (mesh.vertices.size() != reference->mNumVertices || mesh.indices.size() != referenceIndexCount)
+			{
+				difference << "mesh " << m << " has " << mesh.vertices.size() << " vertices and "
+					<< mesh.indices.size() << " indices, Assimp has " << reference->mNumVertices
+					<< " and " << referenceIndexCount;
+				message = difference.str();
+				return false;
+			}
+
+			for (size_t v = 0; v < mesh.vertices.size(); v++)
+			{
+				const Vertex &vertex = mesh.vertices[v];
+				const aiVector3D &position = reference->mVertices[v];
+				glm::vec3 normal(0.0f);
+				if (reference->HasNormals())
+				{
+					normal = glm::vec3(reference->mNormals[v].x, reference->mNormals[v].y, reference->mNormals[v].z);
+				}
+
+				if (vertex.position != glm::vec3(position.x, position.y, position.z))
+				{
+					difference << "mesh " << m << " vertex " << v << " has a different position";
+					message = difference.str();
+					return false;
+				}
+				if (glm::any(glm::greaterThan(glm::abs(vertex.normal - normal), glm::vec3(normalTolerance))))
+				{
+					difference << "mesh " << m << " vertex " << v << " has a different normal";
+					message = difference.str();
+					return false;
+				}
+			}
+
+			size_t i = 0;
+			for (unsigned int f = 0; f < reference->mNumFaces; f++)
+			{
+				const aiFace &face = reference->mFaces[f];
+				for (unsigned int j = 0; j < face.mNumIndices; j++, i++)
+				{
+					if (mesh.indices[i] != face.mIndices[j])
+					{
+						difference << "mesh " << m << " face " << f << " is triangulated differently";
+						message = difference.str();
+						return false;
+					}
+				}
+			}
+		}
+		message = "identical to Assimp";
+		return true;
+	}
+
+	/**
+	 * Describes how far the normals of the meshes marked in generated are
+	 * from the ones Assimp generated, which only match if the vertices do.
+	 */
+	std::string compareNormals(const std::vector<Mesh*> &meshes, const std::vector<bool> &generated,
+			const std::vector<const aiMesh*> &expected)
+	{
+		std::ostringstream difference;
+		if (meshes.size() != expected.size())
+		{
+			difference << meshes.size() << " meshes, Assimp has " << expected.size();
+			return difference.str();
+		}
+
+		float largest = 0.0f;
+		double sum = 0.0;
+		size_t count = 0;
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			if (!generated[m])
+			{
+				continue;
+			}
+
+			const aiMesh* reference = expected[m];
+			if (meshes[m]->getVertexCount() != reference->mNumVertices || !reference->HasNormals())
+			{
+				difference << "mesh " << m << " can't be compared, its vertices differ from Assimp's";
+				return difference.str();
+			}
+
+			const Vertex* vertices = meshes[m]->getVertexData();
+			for (size_t v = 0; v < meshes[m]->getVertexCount(); v++)
+			{
+				glm::vec3 normal(reference->mNormals[v].x, reference->mNormals[v].y, reference->mNormals[v].z);
+				float angle = glm::degrees(std::acos(glm::clamp(glm::dot(vertices[v].normal, normal), -1.0f, 1.0f)));
+				largest = glm::max(largest, angle);
+				sum += angle;
+				count++;
+			}
+		}
+
+		difference << "largest difference to Assimp " << largest << " degrees, mean "
+			<< (count > 0 ? sum / count : 0.0) << " degrees";
+		return difference.str();
+	}
+}
+
+/**
+ * Imports the model and extracts its meshes without touching OpenGL, so
+ * models can be constructed on worker threads. upload() must be called on
+ * the context thread before the model is drawn.
+ */
+Model::Model(const std::string &objPath, const Shader& shader, const ImportSettings& settings) :
+	shader(&shader), vertexArray(nullptr), pendingUploads(nullptr), firstUpload(0), lastUpload(0),
+	meshCache(nullptr), residency(settings.residency), releasedBytes(0), optimized(false),
+	quantized(false), quantizationMeasured(false), modelMatrix(1.0f), fitMatrix(1.0f), m_rotate(0), m_scale(1), m_translation(0)
+{
+	resolveUniforms();
+	loadStatistics = {};
+	Clock::time_point start = Clock::now();
+
+	if (settings.archive)
+	{
+		meshCache = settings.archive->open(objPath, importFlags(settings));
+	}
+	else if (settings.useMeshCache)
+	{
+		meshCache = new MeshCache(objPath, importFlags(settings));
+	}
+
+	bool cached = meshCache && meshCache->load();
+	loadStatistics.readMilliseconds = Milliseconds(Clock::now() - start).count();
+	if (cached)
+	{
+		for (auto &view : meshCache->getMeshes())
+		{
+			Mesh* mesh = new Mesh(view.vertices, view.vertexCount, view.indices, view.indexCount, view.bounds);
+			mesh->setLods(view.lodIndices, view.lodIndexCount, view.lods, view.lodCount);
+			mesh->setMeshlets(view.meshlets, view.meshletCount, view.closed);
+			meshes.push_back(mesh);
+		}
+	}
+	else if (settings.archive)
+	{
+		// Not packed or packed with other settings, import the file instead.
+		// The archive is a snapshot, it is never written back.
+		delete meshCache;
+		meshCache = nullptr;
+	}
+
+	if (meshes.empty())
+	{
+		bool imported = settings.useObjParser ?
+			importWithObjParser(objPath, settings) : importWithAssimp(objPath, settings);
+
+		if (imported && settings.optimizeMeshes)
+		{
+			optimizeMeshes(settings.overdrawThreshold);
+		}
+
+		if (imported)
+		{
+			splitMeshes();
+		}
+
+		if (imported && settings.buildLods)
+		{
+			for (auto mesh : meshes)
+			{
+				mesh->buildLods(maxLods);
+			}
+		}
+
+		if (imported && settings.buildMeshlets)
+		{
+			for (auto mesh : meshes)
+			{
+				mesh->buildMeshlets();
+			}
+		}
+
+		if (imported && meshCache)
+		{
+			meshCache->store(meshes);
+			delete meshCache;
+			meshCache = nullptr;
+		}
+	}
+
+	BoundsBuilder builder;
+	for (auto mesh : meshes)
+	{
+		builder.add(mesh->getBounds());
+	}
+	bounds = builder.build();
+
+	if (settings.quantizeVertices && !meshes.empty())
+	{
+		quantizeMeshes(settings.validateQuantization);
+	}
+
+	if (settings.autoFit && !bounds.isEmpty())
+	{
+		// Center the model and scale it so the longest side of its box is 1.
+		glm::vec3 size = bounds.maximum - bounds.minimum;
+		float longest = glm::max(size.x, glm::max(size.y, size.z));
+		if (longest > 0.0f)
+		{
+			fitMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / longest));
+		}
+		fitMatrix = glm::translate(fitMatrix, -(bounds.minimum + bounds.maximum) * 0.5f);
+	}
+
+	// Whatever wasn't measured by the import itself.
+	loadStatistics.processMilliseconds = glm::max(0.0, Milliseconds(Clock::now() - start).count() -
+			loadStatistics.readMilliseconds - loadStatistics.importMilliseconds -
+			loadStatistics.traverseMilliseconds - loadStatistics.extractMilliseconds);
+	for (auto mesh : meshes)
+	{
+		loadStatistics.cpuBytes += mesh->getDataBytes();
+	}
+}
+
+/**
+ * The post processing Assimp runs. Normals are left to the NormalGenerator
+ * if it is used.
+ */
+unsigned int Model::assimpFlags(const ImportSettings& settings)
+{
+	return settings.generateNormals ? postProcessFlags & ~aiProcess_GenSmoothNormals : postProcessFlags;
+}
+
+/**
+ * Combines every setting that changes the imported meshes, used to tell
+ * whether a MeshCache was written with the same settings. The low 32 bits
+ * are the Assimp post processing flags.
+ */
+uint64_t Model::importFlags(const ImportSettings& settings)
+{
+	uint64_t flags = assimpFlags(settings);
+	if (settings.useObjParser)
+	{
+		flags |= uint64_t(1) << 32;
+	}
+	if (settings.optimizeMeshes)
+	{
+		flags |= uint64_t(1) << 33;
+		// The overdraw threshold in thousandths.
+		flags |= uint64_t(glm::clamp(settings.overdrawThreshold, 0.0f, 65.0f) * 1000.0f) << 34;
+	}
+	if (settings.buildLods)
+	{
+		flags |= uint64_t(1) << 50;
+	}
+	if (settings.buildMeshlets)
+	{
+		flags |= uint64_t(1) << 51;
+	}
+	if (settings.generateNormals)
+	{
+		flags |= uint64_t(1) << 52;
+		// The crease angle in whole degrees.
+		flags |= uint64_t(glm::clamp(settings.creaseAngle, 0.0f, 180.0f) + 0.5f) << 53;
+	}
+	return flags;
+}
+
+bool Model::importWithAssimp(const std::string &objPath, const ImportSettings& settings)
 {
+	double reading = 0.0;
 	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(objPath,
-			aiProcess_Triangulate | aiProcess_GenSmoothNormals);	
+	importer.SetIOHandler(new TimedIOSystem(reading));
+	Clock::time_point start = Clock::now();
+	const aiScene* scene = importer.ReadFile(objPath, assimpFlags(settings));
+	Clock::time_point imported = Clock::now();
+	loadStatistics.readMilliseconds += reading;
+	loadStatistics.importMilliseconds += Milliseconds(imported - start).count() - reading;
 	if (!scene)
 	{
 		std::cerr <<  "Error loading " << objPath << ".\n" << importer.GetErrorString() << std::endl;
+		return false;
+	}
+
+	// extractDataFromNode() measures the copies itself, the rest is traversal.
+	double extracting = loadStatistics.extractMilliseconds;
+	extractDataFromNode(scene, scene->mRootNode);
+	loadStatistics.traverseMilliseconds += Milliseconds(Clock::now() - imported).count() -
+		(loadStatistics.extractMilliseconds - extracting);
+
+	if (settings.generateNormals)
+	{
+		std::vector<const aiMesh*> extracted;
+		collectMeshes(scene, scene->mRootNode, extracted);
+		std::vector<bool> missing;
+		for (auto mesh : extracted)
+		{
+			missing.push_back(!mesh->HasNormals());
+		}
+		generateNormals(objPath, missing, settings);
+	}
+	return true;
+}
+
+/**
+ * Imports the model with the ObjParser. If validateObjParser is set the model
+ * is also imported with Assimp and any difference between the two is reported.
+ * The parser's meshes are then only used if they are identical, otherwise the
+ * model is imported with Assimp.
+ */
+bool Model::importWithObjParser(const std::string &objPath, const ImportSettings& settings)
+{
+	ObjParser parser;
+	Clock::time_point start = Clock::now();
+	bool read = parser.parse(objPath, !settings.generateNormals);
+	loadStatistics.importMilliseconds += Milliseconds(Clock::now() - start).count();
+	if (!read)
+	{
+		return false;
+	}
+	std::vector<ObjParser::MeshData> &parsed = parser.getMeshes();
+
+	if (settings.validateObjParser)
+	{
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(objPath, assimpFlags(settings));
+		std::vector<const aiMesh*> expected;
+		if (scene)
+		{
+			collectMeshes(scene, scene->mRootNode, expected);
+		}
+
+		std::string message;
+		bool identical = compareMeshes(parsed, expected, message);
+		std::ostringstream report;
+		report << "ObjParser " << objPath << ": " << message << (identical ? "" : ", using Assimp instead") << '\n';
+		(identical ? std::cout : std::cerr) << report.str();
+		if (!identical)
+		{
+			return importWithAssimp(objPath, settings);
+		}
+	}
+
+	std::vector<bool> missing;
+	for (auto &mesh : parsed)
+	{
+		missing.push_back(!mesh.hasNormals);
+		meshes.push_back(new Mesh(std::move(mesh.vertices), std::move(mesh.indices)));
+	}
+
+	if (settings.generateNormals)
+	{
+		generateNormals(objPath, missing, settings);
+	}
+	return true;
+}
+
+/**
+ * Generates the normals of the imported meshes marked as missing them. If
+ * validateNormals is set the model is imported with Assimp's normals too,
+ * and how long both took and how far apart the normals are is reported.
+ */
+void Model::generateNormals(const std::string &objPath, const std::vector<bool> &missing,
+		const ImportSettings& settings)
+{
+	Clock::time_point start = Clock::now();
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		if (missing[m])
+		{
+			meshes[m]->generateNormals(settings.creaseAngle);
+		}
+	}
+	double generating = Milliseconds(Clock::now() - start).count();
+
+	if (!settings.validateNormals || std::find(missing.begin(), missing.end(), true) == missing.end())
+	{
+		return;
+	}
+
+	// Assimp's cost of generating normals is the difference between
+	// importing with and without them.
+	Assimp::Importer withoutNormals, withNormals;
+	start = Clock::now();
+	withoutNormals.ReadFile(objPath, postProcessFlags & ~aiProcess_GenSmoothNormals);
+	Clock::time_point middle = Clock::now();
+	const aiScene* scene = withNormals.ReadFile(objPath, postProcessFlags);
+	double assimp = Milliseconds(Clock::now() - middle).count() - Milliseconds(middle - start).count();
+
+	std::vector<const aiMesh*> expected;
+	if (scene)
+	{
+		collectMeshes(scene, scene->mRootNode, expected);
 	}
 
-	extractDataFromNode(scene, scene->mRootNode);	
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(3) << "Normals " << objPath << ": generated in "
+		<< generating << " ms, Assimp in " << glm::max(assimp, 0.0) << " ms, "
+		<< compareNormals(meshes, missing, expected) << '\n';
+	std::cout << report.str();
+}
+
+/**
+ * Optimizes every mesh and sums up the cache statistics of the whole model.
+ */
+void Model::optimizeMeshes(float overdrawThreshold)
+{
+	beforeOptimization = {};
+	afterOptimization = {};
+
+	for (auto mesh : meshes)
+	{
+		MeshOptimizer::Statistics before, after;
+		mesh->optimize(overdrawThreshold, before, after);
+		beforeOptimization.add(before);
+		afterOptimization.add(after);
+	}
+	optimized = true;
+}
+
+/**
+ * Fits the packing to the bounding box of the whole model, so every mesh
+ * in the shared vertex array is decoded with the same uniforms. The packed
+ * vertices are only built in upload(), the float ones stay the source of
+ * truth for the MeshCache.
+ */
+void Model::quantizeMeshes(bool validate)
+{
+	if (bounds.isEmpty())
+	{
+		// No vertices at all.
+		return;
+	}
 
-//	calcBoundingBox(obj);
-	// Scale model so that the longest side of its BoundingBox
-	// has a length of 1.
-//	m_scale = 1 / glm::max(boundingBox.width, glm::max(boundingBox.height, boundingBox.depth));
-//	update();
+	packing = VertexPacking(bounds.minimum, bounds.maximum);
+	quantized = true;
+
+	if (validate)
+	{
+		quantizationError = { 0.0f, 0.0f, 0.0f };
+		for (auto mesh : meshes)
+		{
+			VertexPacking::Error error = packing.measure(mesh->getVertexData(), mesh->getVertexCount());
+			quantizationError.position = glm::max(quantizationError.position, error.position);
+			quantizationError.normalDegrees = glm::max(quantizationError.normalDegrees, error.normalDegrees);
+			quantizationError.shading = glm::max(quantizationError.shading, error.shading);
+		}
+		quantizationMeasured = true;
+	}
+}
+
+/**
+ * Splits meshes too large for uint16_t indices into chunks that are not,
+ * if the vertices copied at the cuts take less memory than the indices save.
+ * The split meshes are cached, so the cost is judged with unpacked vertices.
+ */
+void Model::splitMeshes()
+{
+	const size_t vertexSize = sizeof(Vertex);
+	std::vector<Mesh*> split;
+
+	for (auto mesh : meshes)
+	{
+		if (mesh->getVertexCount() <= Mesh::shortIndexLimit)
+		{
+			split.push_back(mesh);
+			continue;
+		}
+
+		std::vector<MeshOptimizer::Chunk> chunks = MeshOptimizer::splitMesh(mesh->getVertexData(),
+				mesh->getVertexCount(), mesh->getIndexData(), mesh->getIndexCount(), Mesh::shortIndexLimit);
+
+		size_t chunkVertices = 0;
+		for (auto &chunk : chunks)
+		{
+			chunkVertices += chunk.vertices.size();
+		}
+		// Chunks only copy the vertices their triangles use, so they may hold fewer.
+		const size_t vertexCount = mesh->getVertexCount();
+		size_t extraBytes = chunkVertices > vertexCount ? (chunkVertices - vertexCount) * vertexSize : 0;
+		size_t savedBytes = mesh->getIndexCount() * (sizeof(unsigned int) - sizeof(uint16_t));
+
+		if (extraBytes >= savedBytes)
+		{
+			split.push_back(mesh);
+			continue;
+		}
+
+		for (auto &chunk : chunks)
+		{
+			split.push_back(new Mesh(std::move(chunk.vertices), std::move(chunk.indices)));
+		}
+		delete mesh;
+	}
+	meshes = std::move(split);
+}
+
+/**
+ * Returns false if the packed vertices were not validated during this import.
+ */
+bool Model::getQuantizationError(VertexPacking::Error &error) const
+{
+	error = quantizationError;
+	return quantizationMeasured;
+}
+
+/**
+ * Returns false if the meshes were not optimized during this import.
+ */
+bool Model::getOptimizationStatistics(MeshOptimizer::Statistics &before, MeshOptimizer::Statistics &after) const
+{
+	before = beforeOptimization;
+	after = afterOptimization;
+	return optimized;
 }
 
 Model::~Model() 
 {
+	if (pendingUploads)
+	{
+		pendingUploads->cancel(firstUpload, lastUpload);
+	}
 	for(auto m : meshes)
 	{
 		delete m;
 	}
+	delete vertexArray;
+	delete meshCache;
+}
+
+/**
+ * Uploads every mesh to the GPU into one shared VertexArray, so the whole
+ * model is drawn with a single VAO bind and one draw call per index type.
+ * Must be called on the thread that owns the OpenGL context.
+ *
+ * With uploads the data is streamed in over the next frames instead, and
+ * the model may only be drawn once finishUpload() returns true.
+ */
+void Model::upload(UploadManager* uploads)
+{
+	if (vertexArray)
+	{
+		return;
+	}
+
+	Clock::time_point start = Clock::now();
+	size_t vertexCount, indexBytes;
+	bufferSizes(vertexCount, indexBytes);
+	vertexArray = new VertexArray(vertexCount, indexBytes, quantized ? VertexArray::Packed : VertexArray::Float);
+	uploadMeshes(uploads);
+	loadStatistics.uploadMilliseconds = Milliseconds(Clock::now() - start).count();
+	loadStatistics.gpuBytes = vertexArray->getBytes();
+}
+
+/**
+ * Once the copies queued by upload() are done, frees what was only kept for
+ * them. Returns true if the model is on the GPU and can be drawn.
+ */
+bool Model::finishUpload()
+{
+	if (!vertexArray)
+	{
+		return false;
+	}
+	if (pendingUploads)
+	{
+		if (!pendingUploads->isDone(lastUpload))
+		{
+			return false;
+		}
+		pendingUploads = nullptr;
+		releaseUploadData();
+	}
+	return true;
+}
+
+/**
+ * Uploads the model to take the place of previous, e.g. after its file was
+ * reloaded, keeping previous's transformation. If previous's buffers are
+ * large enough and hold the same vertex format they are overwritten with
+ * glBufferSubData instead of allocating new ones. Returns true if they were.
+ * The upload is never streamed, the model can be drawn right away.
+ */
+bool Model::uploadReplacing(Model &previous)
+{
+	if (vertexArray)
+	{
+		return false;
+	}
+
+	Clock::time_point start = Clock::now();
+	size_t vertexCount, indexBytes;
+	bufferSizes(vertexCount, indexBytes);
+	VertexArray::Format format = quantized ? VertexArray::Packed : VertexArray::Float;
+
+	// Buffers still being streamed into can't be overwritten.
+	bool reused = previous.finishUpload() && previous.vertexArray->fits(vertexCount, indexBytes, format);
+	if (reused)
+	{
+		vertexArray = previous.vertexArray;
+		previous.vertexArray = nullptr;
+		vertexArray->clear();
+	}
+	else
+	{
+		vertexArray = new VertexArray(vertexCount, indexBytes, format);
+	}
+
+	modelMatrix = previous.modelMatrix;
+	instances = previous.instances;
+	uploadMeshes(nullptr);
+	loadStatistics.uploadMilliseconds = Milliseconds(Clock::now() - start).count();
+	loadStatistics.gpuBytes = vertexArray->getBytes();
+	return reused;
+}
+
+/**
+ * Total number of vertices and size of the indices of every mesh and level
+ * of detail, what the VertexArray must hold.
+ */
+void Model::bufferSizes(size_t &vertexCount, size_t &indexBytes) const
+{
+	vertexCount = 0;
+	indexBytes = 0;
+	for (auto mesh : meshes)
+	{
+		vertexCount += mesh->getVertexCount();
+		indexBytes += VertexArray::indexBytesFor(mesh->getIndexCount(), mesh->getIndexSize());
+		for (size_t i = 0; i < mesh->getLodCount(); i++)
+		{
+			indexBytes += VertexArray::indexBytesFor(mesh->getLodData()[i].indexCount, mesh->getIndexSize());
+		}
+	}
+}
+
+/**
+ * Adds every mesh to the vertex array, queuing the copies in uploads if set.
+ * The draws are set up right away, the ranges are known before the copies
+ * are done.
+ */
+void Model::uploadMeshes(UploadManager* uploads)
+{
+	uint64_t firstTicket = uploads ? uploads->getNextTicket() : 0;
+	for (auto mesh : meshes)
+	{
+		mesh->upload(*vertexArray, packing, uploads);
+	}
+	meshLods.assign(meshes.size(), 0);
+	clearDrawBatches();
+	for (auto mesh : meshes)
+	{
+		addDraw(mesh->getRange(), 0, mesh->getRange().indexCount);
+	}
+	vertexArray->setInstances(instances.data(), instances.size());
+
+	if (uploads && uploads->getNextTicket() > firstTicket)
+	{
+		pendingUploads = uploads;
+		firstUpload = firstTicket;
+		lastUpload = uploads->getNextTicket() - 1;
+	}
+	else
+	{
+		releaseUploadData();
+	}
+}
+
+/**
+ * Frees the data the copies of the upload read from, and what the residency
+ * doesn't keep of the meshes. Unless they keep everything they no longer
+ * need the mapped cache either.
+ */
+void Model::releaseUploadData()
+{
+	MemoryStatistics before = getMemoryStatistics();
+	for (auto mesh : meshes)
+	{
+		mesh->releaseUploadData(residency);
+	}
+	if (residency != Mesh::Keep)
+	{
+		delete meshCache;
+		meshCache = nullptr;
+	}
+	MemoryStatistics after = getMemoryStatistics();
+	releasedBytes += before.cpuBytes + before.mappedBytes - after.cpuBytes - after.mappedBytes;
+}
+
+size_t Model::getMeshCount() const
+{
+	return meshes.size();
+}
+
+const Model::LoadStatistics& Model::getLoadStatistics() const
+{
+	return loadStatistics;
+}
+
+Model::MemoryStatistics Model::getMemoryStatistics() const
+{
+	MemoryStatistics statistics = {};
+	for (auto mesh : meshes)
+	{
+		statistics.cpuBytes += mesh->getResidentBytes();
+	}
+	statistics.mappedBytes = meshCache ? meshCache->getMappedSize() : 0;
+	statistics.gpuBytes = vertexArray ? vertexArray->getBytes() : 0;
+	statistics.releasedBytes = releasedBytes;
+	return statistics;
+}
+
+/**
+ * Writes the meshes as the MeshCache of objPath would hold them, e.g. into
+ * a MeshArchive. Must be called before upload(), which releases the meshes'
+ * data if it was borrowed.
+ */
+bool Model::writeMeshCache(std::ostream &out, const std::string &objPath, const ImportSettings& settings) const
+{
+	MeshCache cache(objPath, importFlags(settings));
+	return cache.write(out, meshes);
+}
+
+void Model::clearDrawBatches()
+{
+	for (auto &batch : drawBatches)
+	{
+		batch.counts.clear();
+		batch.offsets.clear();
+		batch.baseVertices.clear();
+	}
+	drawStatistics = {};
+}
+
+/**
+ * Adds indexCount indices of range, starting at firstIndex, to the draw call
+ * for range's index type.
+ */
+void Model::addDraw(const VertexArray::Range &range, size_t firstIndex, size_t indexCount)
+{
+	DrawBatch* batch = nullptr;
+	for (auto &candidate : drawBatches)
+	{
+		if (candidate.indexType == range.indexType)
+		{
+			batch = &candidate;
+		}
+	}
+	if (!batch)
+	{
+		drawBatches.push_back({ range.indexType, {}, {}, {} });
+		batch = &drawBatches.back();
+	}
+
+	size_t indexSize = range.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+	batch->counts.push_back(indexCount);
+	batch->offsets.push_back(reinterpret_cast<const void*>(range.indexOffset + firstIndex * indexSize));
+	batch->baseVertices.push_back(range.baseVertex);
+	drawStatistics.triangles += indexCount / 3;
+}
+
+/**
+ * Picks the level of detail of every mesh and fills the draw calls with the
+ * meshes, or their meshlets, that face the camera and are inside the view
+ * frustum. Culling happens in model space, so the camera and the frustum
+ * planes are moved into it instead of moving every bound out of it. Call
+ * after update() and before draw().
+ * parameters:
+ * 		view, perspective: The matrices the model is drawn with.
+ * 		viewportHeight: Height of the viewport in pixels.
+ */
+void Model::prepareDraw(const glm::mat4 &view, const glm::mat4 &perspective, float viewportHeight)
+{
+	if (!instances.empty())
+	{
+		// Culling and levels of detail depend on where each instance is,
+		// so every instance draws all of the full meshes.
+		meshLods.assign(meshes.size(), 0);
+		clearDrawBatches();
+		for (auto mesh : meshes)
+		{
+			addDraw(mesh->getRange(), 0, mesh->getRange().indexCount);
+		}
+		drawStatistics.instances = instances.size();
+		drawStatistics.triangles *= instances.size();
+		return;
+	}
+
+	glm::mat4 modelView = view * modelMatrix * fitMatrix;
+	glm::vec3 camera = glm::inverse(modelView) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	glm::vec4 planes[6];
+	extractFrustumPlanes(perspective * modelView, planes);
+
+	selectLods(camera, perspective, viewportHeight);
+
+	clearDrawBatches();
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const Mesh &mesh = *meshes[i];
+		const VertexArray::Range &range = mesh.getRange(meshLods[i]);
+
+		// The sphere rejects most meshes cheaply, the box is tighter.
+		const Bounds &meshBounds = mesh.getBounds();
+		drawStatistics.meshesTested++;
+		if (!isSphereVisible(planes, meshBounds.center, meshBounds.radius) ||
+				!isBoxVisible(planes, meshBounds.minimum, meshBounds.maximum))
+		{
+			drawStatistics.meshesCulled++;
+			continue;
+		}
+
+		// Only the full mesh is split into meshlets.
+		if (meshLods[i] != 0 || mesh.getMeshletCount() == 0)
+		{
+			addDraw(range, 0, range.indexCount);
+			continue;
+		}
+
+		for (size_t m = 0; m < mesh.getMeshletCount(); m++)
+		{
+			const MeshOptimizer::Meshlet &meshlet = mesh.getMeshletData()[m];
+			drawStatistics.meshletsTested++;
+			// Back faces of open meshes show through their openings.
+			if ((mesh.isClosed() && MeshOptimizer::isBackFacing(meshlet, camera)) ||
+					!isSphereVisible(planes, meshlet.center, meshlet.radius))
+			{
+				drawStatistics.meshletsCulled++;
+				continue;
+			}
+			addDraw(range, meshlet.firstIndex, meshlet.indexCount);
+		}
+	}
+}
+
+const Model::DrawStatistics& Model::getDrawStatistics() const
+{
+	return drawStatistics;
+}
+
+/**
+ * Picks for every mesh the coarsest level of detail whose error covers at
+ * most lodPixelError pixels on screen where the mesh's bounding sphere is
+ * closest to the camera. The camera is in model space, so the distance and
+ * the error are both in model units and the model's scale cancels out.
+ */
+void Model::selectLods(const glm::vec3 &camera, const glm::mat4 &perspective, float viewportHeight)
+{
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const Bounds &meshBounds = meshes[i]->getBounds();
+		float distance = glm::length(camera - meshBounds.center) - meshBounds.radius;
+		float pixelsPerUnit = perspective[1][1] * viewportHeight * 0.5f / glm::max(distance, 1e-3f * meshBounds.radius);
+
+		size_t lod = 0;
+		while (lod < meshes[i]->getLodCount() && meshes[i]->getLodError(lod + 1) * pixelsPerUnit <= lodPixelError)
+		{
+			lod++;
+		}
+		meshLods[i] = lod;
+	}
+}
+
+const Bounds& Model::getBounds() const
+{
+	return bounds;
 }
 
 /**
@@ -46,7 +1080,9 @@ void Model::extractDataFromNode(const aiScene* scene, const aiNode* node)
 	{
 		// aiNode contains indicies to index the objects in aiScene.
 		const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+		Clock::time_point start = Clock::now();
 		meshes.push_back(new Mesh(mesh));
+		loadStatistics.extractMilliseconds += Milliseconds(Clock::now() - start).count();
 	}
 
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
@@ -63,14 +1099,65 @@ void Model::extractDataFromNode(const aiScene* scene, const aiNode* node)
  */
 void Model::draw() const
 {
-	shader.use();
-	sendUniforms();
+	shader->use();
+	vertexArray->bind();
+	submitDraws(glm::mat4(1.0f));
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+/**
+ * Sends the uniforms and issues the draws set up by prepareDraw(), with
+ * placement applied after the model's own transformation. The shader and the
+ * vertex array must already be bound, see DrawQueue. Returns the number of
+ * draw calls.
+ */
+size_t Model::submitDraws(const glm::mat4 &placement) const
+{
+	sendUniforms(placement);
 
-	for(auto &mesh : meshes)
+	size_t drawCalls = 0;
+	for (auto &batch : drawBatches)
 	{
-		mesh->draw();
+		if (batch.counts.empty())
+		{
+			continue;
+		}
+		if (instances.empty())
+		{
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch.counts.data(), batch.indexType,
+					batch.offsets.data(), batch.counts.size(), batch.baseVertices.data());
+			drawCalls++;
+			continue;
+		}
+		for (size_t i = 0; i < batch.counts.size(); i++)
+		{
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batch.counts[i], batch.indexType,
+					batch.offsets[i], instances.size(), batch.baseVertices[i]);
+		}
+		drawCalls += batch.counts.size();
 	}
-	glUseProgram(0);
+	return drawCalls;
+}
+
+const Shader& Model::getShader() const
+{
+	return *shader;
+}
+
+/**
+ * Draws the model with another program from now on, e.g. another variant
+ * of the same shaders, see ShaderPermutations.
+ */
+void Model::setShader(const Shader& shader)
+{
+	this->shader = &shader;
+	resolveUniforms();
+}
+
+unsigned int Model::getVertexArrayId() const
+{
+	return vertexArray->getId();
 }
 
 /**
@@ -103,68 +1190,48 @@ void Model::scale(const float scale)
 	m_scale = scale;
 }
 
-void Model::setFragmentShaderSettings(const FragmentShaderSettings& settings)
+/**
+ * Draws the model once per instance in a single call per mesh, each with
+ * its own transform and material. The material replaces the surface color
+ * and roughness of the Settings uniform block. With no instances the model
+ * is drawn once as usual. Must be called on the thread that owns the OpenGL
+ * context.
+ */
+void Model::setInstances(const std::vector<Instance> &instances)
 {
-	fragmentSettings = settings;	
+	this->instances = instances;
+	if (vertexArray)
+	{
+		vertexArray->setInstances(instances.data(), instances.size());
+	}
+}
+
+size_t Model::getInstanceCount() const
+{
+	return instances.size();
 }
 
 /**
- *	Shader must be in use before this function is called.
+ * Looks up the uniforms sendUniforms() sets, so drawing never does. Only
+ * reads the shader's table of uniforms, it may run on a worker thread.
  */
-void Model::sendUniforms() const
+void Model::resolveUniforms()
 {
-	// Vertex Shader
-	shader.setUniformMatrix4fv("model", modelMatrix);
-
-	// Fragment Shader
-	shader.setUniform1i("useBeckmann", fragmentSettings.useBeckmann);
-	shader.setUniform1i("useGGX", fragmentSettings.useGGX);
-	shader.setUniform1i("useG", fragmentSettings.useG);
-	shader.setUniform1i("useF", fragmentSettings.useF);
-	shader.setUniform1i("usePi", fragmentSettings.usePi);
-	shader.setUniform1i("useDenom", fragmentSettings.useDenom);
-
-	shader.setUniform1f("roughness", fragmentSettings.roughness);
-	shader.setUniform1f("ambientStrength", fragmentSettings.ambientStrength);
-	shader.setUniform1f("diffuseStrength", fragmentSettings.diffuseStrength);
-	shader.setUniform1f("specularStrength", fragmentSettings.specularStrength);
-
-	shader.setUniform3fv("surfaceColor", 1, &fragmentSettings.surfaceColor);
-	shader.setUniform3fv("fresnel", 1, &fragmentSettings.fresnel);
+	uniforms.model = shader->getUniform<glm::mat4>("model");
+	uniforms.instanced = shader->getUniform<int>("instanced");
+	uniforms.quantized = shader->getUniform<int>("quantized");
+	uniforms.positionOffset = shader->getUniform<glm::vec3>("positionOffset");
+	uniforms.positionScale = shader->getUniform<glm::vec3>("positionScale");
 }
 
-/*
-void Model::calcBoundingBox(ObjModel &obj)
+/**
+ *	Shader must be in use before this function is called.
+ */
+void Model::sendUniforms(const glm::mat4 &placement) const
 {
-	float minX = obj[0].vertex[0].pos.x;
-	float maxX = minX;
-	float minY = obj[0].vertex[0].pos.y;
-	float maxY = minY;
-	float minZ = obj[0].vertex[0].pos.z;
-	float maxZ = minZ;
-
-	for (unsigned int tri = 0; tri < obj.triangleCount(); tri++)
-	{
-		const Triangle &triangle = obj[tri];
-
-		for(unsigned int vert = 0; vert < 3; vert++)
-		{
-			minX = glm::min(minX, triangle.vertex[vert].pos.x);
-			maxX = glm::max(maxX, triangle.vertex[vert].pos.x);
-			
-			minY = glm::min(minY, triangle.vertex[vert].pos.y);
-			maxY = glm::max(maxY, triangle.vertex[vert].pos.y);
-			
-			minZ = glm::min(minZ, triangle.vertex[vert].pos.z);
-			maxZ = glm::max(maxZ, triangle.vertex[vert].pos.z);
-			
-		}
-	}
-	boundingBox.x = minX;
-	boundingBox.y = minY;
-	boundingBox.z = maxZ;
-	boundingBox.width = abs(maxX - minX);
-	boundingBox.height = abs(maxY - minY);
-	boundingBox.depth = abs(maxZ - minZ);
+	shader->set(uniforms.model, placement * modelMatrix * fitMatrix);
+	shader->set(uniforms.instanced, !instances.empty());
+	shader->set(uniforms.quantized, quantized);
+	shader->set(uniforms.positionOffset, &packing.getOffset());
+	shader->set(uniforms.positionScale, &packing.getScale());
 }
-*/
@@ -5,54 +5,189 @@
 
 #include "Shader.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshArchive.h"
 
 class Model
 {
 	public:
-		Model(const std::string &objPath, const Shader& shader);
-		~Model();
+		/**
+		 *	Settings that control how a model is imported.
+		 */
+		struct ImportSettings
+		{
+			bool useMeshCache;		// read and write a MeshCache next to the model file
+			const MeshArchive* archive;	// read the meshes from this archive instead, if not nullptr
+			bool useObjParser;		// import with the ObjParser instead of Assimp
+			bool validateObjParser;	// compare the ObjParser's meshes against Assimp's
+			bool generateNormals;	// generate missing normals with the NormalGenerator instead of Assimp
+			float creaseAngle;		// in degrees, faces further apart than this aren't smoothed together
+			bool validateNormals;	// compare the generated normals against Assimp's
+			bool optimizeMeshes;	// weld vertices and reorder for the vertex caches
+			float overdrawThreshold;	// when optimizing, also sort to reduce overdraw if > 0
+			bool quantizeVertices;	// upload PackedVertex instead of Vertex
+			bool validateQuantization;	// measure the error of the packed vertices
+			bool buildLods;			// simplify every mesh into levels of detail
+			bool buildMeshlets;		// split every mesh into meshlets that are culled while drawing
+			Mesh::Residency residency;	// what the meshes keep in memory once uploaded
+			bool autoFit;			// center the model and scale it to fit in a unit box
+		};
+
+		/**
+		 * What the last prepareDraw() submitted.
+		 */
+		struct DrawStatistics
+		{
+			size_t instances;
+			size_t triangles;			// of every instance together
+			size_t meshesTested;
+			size_t meshesCulled;
+			size_t meshletsTested;
+			size_t meshletsCulled;
+		};
+
+		/**
+		 * Where the time went while loading the model, in milliseconds, and
+		 * how much memory it took.
+		 *	read: Opening and reading the model file, or its MeshCache.
+		 *	import: Parsing the file with Assimp's ReadFile or the ObjParser,
+		 *	        which maps the file and reads it while parsing.
+		 *	traverse: Walking Assimp's nodes in extractDataFromNode().
+		 *	extract: Copying Assimp's meshes in Mesh::extractDataFromMesh().
+		 *	process: The rest of the constructor, e.g. normals and optimizing.
+		 *	upload: upload(), which only queues the copies when streaming.
+		 *	cpuBytes: Mesh data in memory once constructed, mapped or not.
+		 *	gpuBytes: Size of the buffers once uploaded.
+		 */
+		struct LoadStatistics
+		{
+			double readMilliseconds;
+			double importMilliseconds;
+			double traverseMilliseconds;
+			double extractMilliseconds;
+			double processMilliseconds;
+			double uploadMilliseconds;
+			size_t cpuBytes;
+			size_t gpuBytes;
+		};
 
 		/**
-		 *	Settings that will be set in the fragment shader.
+		 * Memory the model takes right now.
+		 *	cpuBytes: Owned by its meshes.
+		 *	mappedBytes: Of the MeshCache its meshes still point into.
+		 *	gpuBytes: Size of its buffers.
+		 *	releasedBytes: Freed or unmapped once the upload was done.
 		 */
-		struct FragmentShaderSettings
+		struct MemoryStatistics
 		{
-			bool useBeckmann;
-			bool useGGX;
-			bool useG;
-			bool useF;
-			bool useDenom;
-			bool usePi;
-			
-			float roughness;
-			float ambientStrength;
-			float diffuseStrength;
-			float specularStrength;
-
-			glm::vec3 surfaceColor;
-			glm::vec3 fresnel;
+			size_t cpuBytes;
+			size_t mappedBytes;
+			size_t gpuBytes;
+			size_t releasedBytes;
 		};
+
+		static const unsigned int maxLods = 5;
+		static constexpr float lodPixelError = 1.0f;	// largest error on screen a level of detail may have
+
+		Model(const std::string &objPath, const Shader& shader, const ImportSettings& settings);
+		~Model();
+		void upload(UploadManager* uploads = nullptr);
+		bool finishUpload();
+		bool uploadReplacing(Model &previous);
+		size_t getMeshCount() const;
+		const LoadStatistics& getLoadStatistics() const;
+		MemoryStatistics getMemoryStatistics() const;
+		bool writeMeshCache(std::ostream &out, const std::string &objPath, const ImportSettings& settings) const;
+		bool getOptimizationStatistics(MeshOptimizer::Statistics &before, MeshOptimizer::Statistics &after) const;
+		bool getQuantizationError(VertexPacking::Error &error) const;
+
+		void prepareDraw(const glm::mat4 &view, const glm::mat4 &perspective, float viewportHeight);
+		const DrawStatistics& getDrawStatistics() const;
+		const Bounds& getBounds() const;
 		void draw() const;
+		size_t submitDraws(const glm::mat4 &placement) const;
+		const Shader& getShader() const;
+		void setShader(const Shader& shader);
+		unsigned int getVertexArrayId() const;
 		void update();
 		void rotate(const glm::vec3 &rotate);
 		void scale(float scale);
-		void setFragmentShaderSettings(const FragmentShaderSettings& settings);
+		void setInstances(const std::vector<Instance> &instances);
+		size_t getInstanceCount() const;
 
 	private:
-		const Shader& shader;
+		/**
+		 * The uniforms sendUniforms() sets, resolved once from the shader.
+		 */
+		struct Uniforms
+		{
+			Shader::Uniform<glm::mat4> model;
+			Shader::Uniform<int> instanced;
+			Shader::Uniform<int> quantized;
+			Shader::Uniform<glm::vec3> positionOffset;
+			Shader::Uniform<glm::vec3> positionScale;
+		};
+
+		const Shader* shader;
+		Uniforms uniforms;
 		std::vector<Mesh*> meshes;
-		FragmentShaderSettings fragmentSettings;
+		VertexArray* vertexArray;	// holds every mesh, see upload()
+		UploadManager* pendingUploads;	// where copies of the meshes are still queued
+		uint64_t firstUpload;		// tickets of those copies
+		uint64_t lastUpload;
 
+		/**
+		 * Parameters of one multi draw call. Every mesh with the same index
+		 * type is drawn by the same call.
+		 */
+		struct DrawBatch
+		{
+			unsigned int indexType;
+			std::vector<int> counts;
+			std::vector<const void*> offsets;
+			std::vector<int> baseVertices;
+		};
+		std::vector<DrawBatch> drawBatches;
+		std::vector<size_t> meshLods;	// level of detail drawn of every mesh
+		std::vector<Instance> instances;	// drawn instead of the model itself if not empty
+		DrawStatistics drawStatistics;
+		LoadStatistics loadStatistics;
+
+		MeshCache* meshCache;		// owns the mesh data if loaded from the cache, see releaseUploadData()
+		Mesh::Residency residency;
+		size_t releasedBytes;		// see MemoryStatistics
+		bool optimized;
+		MeshOptimizer::Statistics beforeOptimization;
+		MeshOptimizer::Statistics afterOptimization;
+		bool quantized;
+		bool quantizationMeasured;
+		VertexPacking packing;		// shared by every mesh so one set of uniforms decodes them
+		VertexPacking::Error quantizationError;
+
+		Bounds bounds;				// of every mesh, in the model file's coordinates
 		glm::mat4 modelMatrix;
+		glm::mat4 fitMatrix;		// applied before modelMatrix, see ImportSettings::autoFit
 		glm::vec3 m_rotate;			// how much to rotate along each axis
 		float m_scale;				// scale to apply to model
 		glm::vec3 m_translation;	// translation vector
 
-		struct BoundingBox
-		{
-			float x, y, z, width, height, depth;
-		} boundingBox;
+		static const unsigned int postProcessFlags;
+		static unsigned int assimpFlags(const ImportSettings& settings);
+		static uint64_t importFlags(const ImportSettings& settings);
 
+		bool importWithAssimp(const std::string &objPath, const ImportSettings& settings);
+		bool importWithObjParser(const std::string &objPath, const ImportSettings& settings);
+		void generateNormals(const std::string &objPath, const std::vector<bool> &missing, const ImportSettings& settings);
+		void optimizeMeshes(float overdrawThreshold);
+		void quantizeMeshes(bool validate);
+		void splitMeshes();
+		void selectLods(const glm::vec3 &camera, const glm::mat4 &perspective, float viewportHeight);
+		void bufferSizes(size_t &vertexCount, size_t &indexBytes) const;
+		void uploadMeshes(UploadManager* uploads);
+		void releaseUploadData();
+		void clearDrawBatches();
+		void addDraw(const VertexArray::Range &range, size_t firstIndex, size_t indexCount);
 		void extractDataFromNode(const aiScene* scene, const aiNode* node);
-		void sendUniforms() const;
+		void resolveUniforms();
+		void sendUniforms(const glm::mat4 &placement) const;
 };
@@ -0,0 +1,182 @@
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <thread>
+
+#include "NormalGenerator.h"
+#include "Parallel.h"
+
+namespace
+{
+	// Vertices handled by one task, large enough to keep the threads busy.
+	const size_t blockSize = 4096;
+
+	struct PositionBits
+	{
+		size_t operator()(const glm::vec3 &p) const
+		{
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+
+		bool operator()(const glm::vec3 &a, const glm::vec3 &b) const
+		{
+			return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+		}
+	};
+
+	/**
+	 * Runs task(begin, end) for consecutive ranges of [0, count) in parallel.
+	 */
+	template<typename Task>
+	void parallelBlocks(size_t count, Task task)
+	{
+		parallelFor((count + blockSize - 1) / blockSize, [count, &task](size_t block) {
+			task(block * blockSize, std::min(count, (block + 1) * blockSize));
+		});
+	}
+
+	/**
+	 * For every vertex, the lowest index of a vertex at exactly the same
+	 * position. The vertices are split between the threads by hash, so
+	 * each thread owns a separate map and the result doesn't depend on
+	 * the number of threads.
+	 */
+	std::vector<unsigned int> groupByPosition(const std::vector<Vertex> &vertices)
+	{
+		const size_t vertexCount = vertices.size();
+		std::vector<glm::vec3> keys(vertexCount);
+		std::vector<size_t> hashes(vertexCount);
+		parallelBlocks(vertexCount, [&](size_t begin, size_t end) {
+			for (size_t v = begin; v < end; v++)
+			{
+				// Adding zero turns -0 into 0 so both end up in the same group.
+				keys[v] = vertices[v].position + glm::vec3(0.0f);
+				hashes[v] = PositionBits()(keys[v]);
+			}
+		});
+
+		const size_t partitionCount = std::min<size_t>((vertexCount + blockSize - 1) / blockSize,
+				std::max(1u, std::thread::hardware_concurrency()));
+		std::vector<unsigned int> group(vertexCount);
+		parallelFor(partitionCount, [&](size_t partition) {
+			std::unordered_map<glm::vec3, unsigned int, PositionBits, PositionBits> first;
+			for (unsigned int v = 0; v < vertexCount; v++)
+			{
+				if (hashes[v] % partitionCount == partition)
+				{
+					group[v] = first.emplace(keys[v], v).first->second;
+				}
+			}
+		});
+		return group;
+	}
+}
+
+/**
+ * Replaces the normal of every vertex used by a triangle. Triangles meeting
+ * at a vertex's position are only smoothed into it if their normal is within
+ * creaseAngle degrees of the vertex's own triangles. A vertex shared by
+ * triangles on both sides of a crease keeps a single, averaged normal; it
+ * would have to be split to be sharp.
+ */
+void NormalGenerator::generate(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+		float creaseAngle)
+{
+	const size_t vertexCount = vertices.size();
+	const size_t triangleCount = indices.size() / 3;
+	if (vertexCount == 0 || triangleCount == 0)
+	{
+		return;
+	}
+
+	// Face normals and what each corner adds to its vertex. The length of
+	// the cross product is twice the triangle's area.
+	std::vector<glm::vec3> faceNormals(triangleCount);
+	std::vector<glm::vec3> contributions(triangleCount * 3);
+	parallelBlocks(triangleCount, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++)
+		{
+			const glm::vec3 p[3] = {
+				vertices[indices[t * 3]].position,
+				vertices[indices[t * 3 + 1]].position,
+				vertices[indices[t * 3 + 2]].position
+			};
+			glm::vec3 cross = glm::cross(p[1] - p[0], p[2] - p[0]);
+			float length = glm::length(cross);
+			faceNormals[t] = length > 0.0f ? cross / length : glm::vec3(0.0f);
+
+			for (int c = 0; c < 3; c++)
+			{
+				glm::vec3 e1 = p[(c + 1) % 3] - p[c];
+				glm::vec3 e2 = p[(c + 2) % 3] - p[c];
+				float lengths = glm::length(e1) * glm::length(e2);
+				float angle = lengths > 0.0f ? std::acos(glm::clamp(glm::dot(e1, e2) / lengths, -1.0f, 1.0f)) : 0.0f;
+				contributions[t * 3 + c] = cross * angle;
+			}
+		}
+	});
+
+	// List the corners at every position, indexed by the group's first vertex.
+	std::vector<unsigned int> group = groupByPosition(vertices);
+	std::vector<unsigned int> cornerStart(vertexCount + 1, 0);
+	for (size_t c = 0; c < triangleCount * 3; c++)
+	{
+		cornerStart[group[indices[c]] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		cornerStart[v + 1] += cornerStart[v];
+	}
+	std::vector<unsigned int> corners(triangleCount * 3);
+	std::vector<unsigned int> cornerEnd(cornerStart.begin(), cornerStart.end() - 1);
+	for (size_t c = 0; c < triangleCount * 3; c++)
+	{
+		corners[cornerEnd[group[indices[c]]]++] = c;
+	}
+
+	// Past 180 degrees every triangle counts, also for rounded dot products.
+	const float minDot = creaseAngle >= 180.0f ? -2.0f : std::cos(glm::radians(creaseAngle));
+	parallelBlocks(vertexCount, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; v++)
+		{
+			const unsigned int first = cornerStart[group[v]];
+			const unsigned int last = cornerStart[group[v] + 1];
+			if (first == last)
+			{
+				continue;
+			}
+
+			glm::vec3 reference(0.0f);
+			for (unsigned int i = first; i < last; i++)
+			{
+				if (indices[corners[i]] == v)
+				{
+					reference += faceNormals[corners[i] / 3];
+				}
+			}
+			// A vertex only used by degenerate triangles is smoothed with every
+			// triangle at its position.
+			bool degenerate = reference == glm::vec3(0.0f);
+			if (!degenerate)
+			{
+				reference = glm::normalize(reference);
+			}
+
+			glm::vec3 normal(0.0f);
+			for (unsigned int i = first; i < last; i++)
+			{
+				if (degenerate || glm::dot(faceNormals[corners[i] / 3], reference) >= minDot)
+				{
+					normal += contributions[corners[i]];
+				}
+			}
+			float length = glm::length(normal);
+			vertices[v].normal = length > 0.0f ? normal / length : reference;
+		}
+	});
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+ * Generates smooth vertex normals for meshes that have none, in
+ * place of aiProcess_GenSmoothNormals. Every triangle adds its normal
+ * to the vertices at its corners, weighted by its area and by the
+ * angle at the corner, so small slivers and fans of thin triangles
+ * don't pull the normal to one side. Vertices at the same position
+ * are smoothed together, which is what joins the separate corners
+ * Assimp's OBJ importer creates, except across creases.
+ *
+ * The work is spread over the hardware threads.
+ */
+
+#include <vector>
+
+#include "Vertex.h"
+
+class NormalGenerator
+{
+	public:
+		// Assimp's default for AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE.
+		static constexpr float defaultCreaseAngle = 175.0f;
+
+		static void generate(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+				float creaseAngle = defaultCreaseAngle);
+};
@@ -0,0 +1,710 @@
+#include <assimp/fast_atof.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+namespace
+{
+	const size_t minChunkSize = 256 * 1024;
+	const int noIndex = -1;
+
+	/**
+	 * One vertex of a face. Negative OBJ indices are relative to the
+	 * attributes read so far, which depends on the chunks before this one.
+	 * They are stored relative to the chunk and flagged until resolved.
+	 */
+	struct Corner
+	{
+		int position;
+		int normal;
+		unsigned char relative;
+	};
+	const unsigned char relativePosition = 1;
+	const unsigned char relativeNormal = 2;
+
+	struct Face
+	{
+		size_t firstCorner;
+		unsigned int cornerCount;
+	};
+
+	/**
+	 * An 'o', 'g' or 'usemtl' statement, placed before the face at faceIndex.
+	 */
+	struct Event
+	{
+		enum Type { Object, Material } type;
+		size_t faceIndex;
+		std::string name;
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<Corner> corners;
+		std::vector<Face> faces;
+		std::vector<Event> events;
+
+		// Offsets of this chunk in the concatenated arrays.
+		size_t positionOffset;
+		size_t normalOffset;
+		size_t cornerOffset;
+		size_t faceOffset;
+	};
+
+	bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	bool isLineEnd(const char* c, const char* end)
+	{
+		return c == end || *c == '\n' || *c == '\r';
+	}
+
+	const char* skipSpaces(const char* c, const char* end)
+	{
+		while (c != end && isSpace(*c))
+		{
+			c++;
+		}
+		return c;
+	}
+
+	const char* skipLine(const char* c, const char* end)
+	{
+		while (c != end && *c != '\n')
+		{
+			c++;
+		}
+		return c == end ? c : c + 1;
+	}
+
+	/**
+	 * Reads a float the same way Assimp does so the values match exactly.
+	 * The buffer is not null terminated, so the token is copied first.
+	 */
+	const char* readFloat(const char* c, const char* end, float &value)
+	{
+		char token[64];
+		size_t length = 0;
+		c = skipSpaces(c, end);
+		while (c != end && !isSpace(*c) && !isLineEnd(c, end) && length < sizeof(token) - 1)
+		{
+			token[length++] = *c++;
+		}
+		token[length] = '\0';
+
+		value = 0.0f;
+		if (length > 0)
+		{
+			try
+			{
+				Assimp::fast_atoreal_move<float>(token, value);
+			}
+			catch (const std::invalid_argument&)
+			{
+				value = 0.0f;
+			}
+		}
+		return c;
+	}
+
+	const char* readInt(const char* c, const char* end, int &value)
+	{
+		bool negative = c != end && *c == '-';
+		if (negative || (c != end && *c == '+'))
+		{
+			c++;
+		}
+
+		value = 0;
+		while (c != end && *c >= '0' && *c <= '9')
+		{
+			value = value * 10 + (*c - '0');
+			c++;
+		}
+		if (negative)
+		{
+			value = -value;
+		}
+		return c;
+	}
+
+	/**
+	 * Converts a 1 based OBJ index into a 0 based one. Negative indices are
+	 * made relative to the start of the chunk and flagged.
+	 */
+	int resolveIndex(int index, size_t countInChunk, unsigned char flag, unsigned char &relative)
+	{
+		if (index > 0)
+		{
+			return index - 1;
+		}
+		if (index < 0)
+		{
+			relative |= flag;
+			return int(countInChunk) + index;
+		}
+		return noIndex;
+	}
+
+	std::string readName(const char* c, const char* end)
+	{
+		c = skipSpaces(c, end);
+		const char* nameEnd = c;
+		while (!isLineEnd(nameEnd, end))
+		{
+			nameEnd++;
+		}
+		while (nameEnd != c && isSpace(nameEnd[-1]))
+		{
+			nameEnd--;
+		}
+		return std::string(c, nameEnd);
+	}
+
+	void parseFace(const char* c, const char* end, Chunk &chunk)
+	{
+		Face face = { chunk.corners.size(), 0 };
+
+		while (true)
+		{
+			c = skipSpaces(c, end);
+			if (isLineEnd(c, end) || *c == '#')
+			{
+				break;
+			}
+
+			// v, v/vt, v//vn or v/vt/vn. Texture coordinates are not used.
+			int position = 0, texCoord = 0, normal = 0;
+			c = readInt(c, end, position);
+			if (c != end && *c == '/')
+			{
+				c = readInt(c + 1, end, texCoord);
+				if (c != end && *c == '/')
+				{
+					c = readInt(c + 1, end, normal);
+				}
+			}
+			while (c != end && !isSpace(*c) && !isLineEnd(c, end))
+			{
+				c++;
+			}
+
+			Corner corner = { noIndex, noIndex, 0 };
+			corner.position = resolveIndex(position, chunk.positions.size(), relativePosition, corner.relative);
+			corner.normal = resolveIndex(normal, chunk.normals.size(), relativeNormal, corner.relative);
+			if (corner.position == noIndex && !(corner.relative & relativePosition))
+			{
+				continue;
+			}
+			chunk.corners.push_back(corner);
+			face.cornerCount++;
+		}
+
+		// Points and lines are not drawn.
+		if (face.cornerCount < 3)
+		{
+			chunk.corners.resize(face.firstCorner);
+			return;
+		}
+		chunk.faces.push_back(face);
+	}
+
+	void parseChunk(Chunk &chunk)
+	{
+		const char* c = chunk.begin;
+		const char* end = chunk.end;
+
+		while (c != end)
+		{
+			c = skipSpaces(c, end);
+			if (c == end)
+			{
+				break;
+			}
+
+			if (c[0] == 'v' && c + 1 != end && isSpace(c[1]))
+			{
+				glm::vec3 position;
+				c = readFloat(c + 1, end, position.x);
+				c = readFloat(c, end, position.y);
+				c = readFloat(c, end, position.z);
+				chunk.positions.push_back(position);
+			}
+			else if (c[0] == 'v' && c + 2 < end && c[1] == 'n' && isSpace(c[2]))
+			{
+				glm::vec3 normal;
+				c = readFloat(c + 2, end, normal.x);
+				c = readFloat(c, end, normal.y);
+				c = readFloat(c, end, normal.z);
+				chunk.normals.push_back(normal);
+			}
+			else if (c[0] == 'f' && c + 1 != end && isSpace(c[1]))
+			{
+				parseFace(c + 1, end, chunk);
+			}
+			else if ((c[0] == 'o' || c[0] == 'g') && c + 1 != end && isSpace(c[1]))
+			{
+				chunk.events.push_back({ Event::Object, chunk.faces.size(), readName(c + 1, end) });
+			}
+			else if (end - c >= 7 && std::equal(c, c + 6, "usemtl") && isSpace(c[6]))
+			{
+				chunk.events.push_back({ Event::Material, chunk.faces.size(), readName(c + 6, end) });
+			}
+			c = skipLine(c, end);
+		}
+	}
+
+	/**
+	 * Splits the file into roughly equal chunks that end on a line break.
+	 */
+	std::vector<Chunk> splitIntoChunks(const char* data, size_t size)
+	{
+		size_t threads = std::max(1u, std::thread::hardware_concurrency());
+		size_t count = std::max<size_t>(1, std::min(threads, size / minChunkSize));
+
+		std::vector<Chunk> chunks(count);
+		const char* begin = data;
+		const char* end = data + size;
+		for (size_t i = 0; i < count; i++)
+		{
+			const char* chunkEnd = i + 1 == count ? end : data + size * (i + 1) / count;
+			chunkEnd = std::max(chunkEnd, begin);
+			while (chunkEnd != end && chunkEnd[-1] != '\n')
+			{
+				chunkEnd++;
+			}
+			chunks[i].begin = begin;
+			chunks[i].end = chunkEnd;
+			begin = chunkEnd;
+		}
+		return chunks;
+	}
+
+	glm::vec3 normalizeSafe(const glm::vec3 &v)
+	{
+		float length = glm::length(v);
+		return length > 0.0f ? v / length : v;
+	}
+
+	/**
+	 * True if p1 lies left of the line from p0 to p2.
+	 */
+	bool onLeftSideOfLine(const glm::vec2 &p0, const glm::vec2 &p2, const glm::vec2 &p1)
+	{
+		return ((p2.x - p0.x) * (p1.y - p0.y) - (p1.x - p0.x) * (p2.y - p0.y)) > 0;
+	}
+
+	bool pointInTriangle(const glm::vec2 &p0, const glm::vec2 &p1, const glm::vec2 &p2, const glm::vec2 &point)
+	{
+		const glm::vec2 v0 = p1 - p0;
+		const glm::vec2 v1 = p2 - p0;
+		const glm::vec2 v2 = point - p0;
+		double dot00 = glm::dot(v0, v0);
+		double dot01 = glm::dot(v0, v1);
+		double dot02 = glm::dot(v0, v2);
+		double dot11 = glm::dot(v1, v1);
+		double dot12 = glm::dot(v1, v2);
+		const double invDenom = 1 / (dot00 * dot11 - dot01 * dot01);
+		double u = (dot11 * dot02 - dot01 * dot12) * invDenom;
+		double v = (dot00 * dot12 - dot01 * dot02) * invDenom;
+		return u > 0 && v > 0 && u + v < 1;
+	}
+
+	/**
+	 * Triangulates a polygon made of the vertices [first, first + count)
+	 * following the rules of Assimp's TriangulateProcess: quads are split at
+	 * their concave corner if they have one, larger polygons are projected
+	 * along their Newell normal and ear clipped.
+	 */
+	void triangulate(const std::vector<Vertex> &vertices, unsigned int first, unsigned int count,
+			std::vector<unsigned int> &indices)
+	{
+		auto position = [&](unsigned int i) { return vertices[first + i].position; };
+
+		if (count == 3)
+		{
+			indices.insert(indices.end(), { first, first + 1, first + 2 });
+			return;
+		}
+
+		if (count == 4)
+		{
+			unsigned int start = 0;
+			for (unsigned int i = 0; i < 4; i++)
+			{
+				const glm::vec3 v = position(i);
+				glm::vec3 left = position((i + 3) % 4) - v;
+				glm::vec3 diagonal = position((i + 2) % 4) - v;
+				glm::vec3 right = position((i + 1) % 4) - v;
+				left /= glm::length(left);
+				diagonal /= glm::length(diagonal);
+				right /= glm::length(right);
+
+				float angle = std::acos(glm::dot(left, diagonal)) + std::acos(glm::dot(right, diagonal));
+				if (angle > glm::pi<float>())
+				{
+					start = i;
+					break;
+				}
+			}
+			indices.insert(indices.end(), {
+				first + start, first + (start + 1) % 4, first + (start + 2) % 4,
+				first + start, first + (start + 2) % 4, first + (start + 3) % 4
+			});
+			return;
+		}
+
+		// Newell normal of the polygon.
+		glm::vec3 normal(0.0f);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const glm::vec3 low = position(i);
+			const glm::vec3 mid = position((i + 1) % count);
+			const glm::vec3 high = position((i + 2) % count);
+			normal.z += mid.x * (high.y - low.y);
+			normal.x += mid.y * (high.z - low.z);
+			normal.y += mid.z * (high.x - low.x);
+		}
+
+		// Drop the axis the normal is largest along, keeping the winding.
+		int a = 0, b = 1;
+		float inv = normal.z;
+		const glm::vec3 n = glm::abs(normal);
+		if (n.x > n.y)
+		{
+			if (n.x > n.z)
+			{
+				a = 1; b = 2; inv = normal.x;
+			}
+		}
+		else if (n.y > n.z)
+		{
+			a = 2; b = 0; inv = normal.y;
+		}
+		if (inv < 0.0f)
+		{
+			std::swap(a, b);
+		}
+
+		std::vector<glm::vec2> projected(count);
+		std::vector<bool> done(count, false);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			projected[i] = glm::vec2(position(i)[a], position(i)[b]);
+		}
+
+		unsigned int ear = 0, prev = count - 1, next = 0, remaining = count;
+		while (remaining > 3)
+		{
+			int wraps = 0;
+			for (ear = next;; prev = ear, ear = next)
+			{
+				for (next = ear + 1; done[next >= count ? next = 0 : next]; next++);
+				if (next < ear && ++wraps == 2)
+				{
+					break;
+				}
+
+				const glm::vec2 &p0 = projected[prev];
+				const glm::vec2 &p1 = projected[ear];
+				const glm::vec2 &p2 = projected[next];
+				if (onLeftSideOfLine(p0, p2, p1))
+				{
+					continue;
+				}
+
+				unsigned int i = 0;
+				for (; i < count; i++)
+				{
+					const glm::vec2 &p = projected[i];
+					if (p != p1 && p != p2 && p != p0 && pointInTriangle(p0, p1, p2, p))
+					{
+						break;
+					}
+				}
+				if (i == count)
+				{
+					break;
+				}
+			}
+
+			if (wraps == 2)
+			{
+				// Not a simple polygon. Assimp drops the rest of it as well.
+				return;
+			}
+
+			indices.insert(indices.end(), { first + prev, first + ear, first + next });
+			done[ear] = true;
+			remaining--;
+		}
+
+		unsigned int i = 0;
+		for (; done[i]; i++);
+		unsigned int i0 = i;
+		for (i++; done[i]; i++);
+		unsigned int i1 = i;
+		for (i++; done[i]; i++);
+		indices.insert(indices.end(), { first + i0, first + i1, first + i });
+	}
+
+	/**
+	 * Generates normals the way aiProcess_GenSmoothNormals does: every vertex
+	 * gets the normal of the last triangle using it, then all vertices within
+	 * a small distance of each other get the normalized sum of their normals.
+	 */
+	void generateSmoothNormals(ObjParser::MeshData &mesh)
+	{
+		std::vector<Vertex> &vertices = mesh.vertices;
+		const std::vector<unsigned int> &indices = mesh.indices;
+		if (vertices.empty())
+		{
+			return;
+		}
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			const glm::vec3 &v0 = vertices[indices[i]].position;
+			const glm::vec3 &v1 = vertices[indices[i + 1]].position;
+			const glm::vec3 &v2 = vertices[indices[i + 2]].position;
+			glm::vec3 normal = normalizeSafe(glm::cross(v1 - v0, v2 - v0));
+
+			vertices[indices[i]].normal = normal;
+			vertices[indices[i + 1]].normal = normal;
+			vertices[indices[i + 2]].normal = normal;
+		}
+
+		glm::vec3 minimum = vertices[0].position;
+		glm::vec3 maximum = minimum;
+		for (auto &vertex : vertices)
+		{
+			minimum = glm::min(minimum, vertex.position);
+			maximum = glm::max(maximum, vertex.position);
+		}
+		const float epsilon = glm::length(maximum - minimum) * 1e-4f;
+
+		// Sort the vertices by their distance along an arbitrary plane normal
+		// so the neighbours of a vertex are found with a binary search.
+		struct Entry
+		{
+			unsigned int index;
+			glm::vec3 position;
+			float distance;
+			bool operator<(const Entry &other) const { return distance < other.distance; }
+		};
+		const glm::vec3 planeNormal = glm::normalize(glm::vec3(0.8523f, 0.34321f, 0.5736f));
+		std::vector<Entry> entries;
+		entries.reserve(vertices.size());
+		for (unsigned int i = 0; i < vertices.size(); i++)
+		{
+			const glm::vec3 &p = vertices[i].position;
+			entries.push_back({ i, p, glm::dot(p, planeNormal) });
+		}
+		std::sort(entries.begin(), entries.end());
+
+		std::vector<glm::vec3> smoothed(vertices.size(), glm::vec3(0.0f));
+		std::vector<bool> handled(vertices.size(), false);
+		std::vector<unsigned int> found;
+		for (unsigned int i = 0; i < vertices.size(); i++)
+		{
+			if (handled[i])
+			{
+				continue;
+			}
+
+			const glm::vec3 &p = vertices[i].position;
+			const float distance = glm::dot(p, planeNormal);
+			const float minDistance = distance - epsilon;
+			const float maxDistance = distance + epsilon;
+			auto first = std::lower_bound(entries.begin(), entries.end(), minDistance,
+					[](const Entry &entry, float value) { return entry.distance < value; });
+
+			found.clear();
+			for (auto it = first; it != entries.end() && it->distance < maxDistance; it++)
+			{
+				glm::vec3 offset = it->position - p;
+				if (glm::dot(offset, offset) < epsilon * epsilon)
+				{
+					found.push_back(it->index);
+				}
+			}
+
+			glm::vec3 normal(0.0f);
+			for (auto index : found)
+			{
+				normal += vertices[index].normal;
+			}
+			normal = normalizeSafe(normal);
+
+			for (auto index : found)
+			{
+				smoothed[index] = normal;
+				handled[index] = true;
+			}
+		}
+
+		for (unsigned int i = 0; i < vertices.size(); i++)
+		{
+			vertices[i].normal = smoothed[i];
+		}
+	}
+}
+
+/**
+ * Parses the file. Returns false if it could not be read. If generateNormals
+ * is false, meshes without normals are left without them.
+ */
+bool ObjParser::parse(const std::string &objPath, bool generateNormals)
+{
+	meshes.clear();
+
+	MappedFile file(objPath);
+	if (!file.isOpen())
+	{
+		std::cerr << "Error loading " << objPath << ".\nCould not read the file." << std::endl;
+		return false;
+	}
+
+	// Parse the chunks independently, indices that reach into earlier
+	// chunks are resolved once the number of attributes in each is known.
+	std::vector<Chunk> chunks = splitIntoChunks(file.data(), file.size());
+	parallelFor(chunks.size(), [&chunks](size_t i) { parseChunk(chunks[i]); });
+
+	size_t positionCount = 0, normalCount = 0, cornerCount = 0, faceCount = 0;
+	for (auto &chunk : chunks)
+	{
+		chunk.positionOffset = positionCount;
+		chunk.normalOffset = normalCount;
+		chunk.cornerOffset = cornerCount;
+		chunk.faceOffset = faceCount;
+		positionCount += chunk.positions.size();
+		normalCount += chunk.normals.size();
+		cornerCount += chunk.corners.size();
+		faceCount += chunk.faces.size();
+	}
+
+	std::vector<glm::vec3> positions(positionCount);
+	std::vector<glm::vec3> normals(normalCount);
+	std::vector<Corner> corners(cornerCount);
+	std::vector<Face> faces(faceCount);
+	parallelFor(chunks.size(), [&](size_t i) {
+		Chunk &chunk = chunks[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionOffset);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalOffset);
+
+		for (size_t c = 0; c < chunk.corners.size(); c++)
+		{
+			Corner corner = chunk.corners[c];
+			if (corner.relative & relativePosition)
+			{
+				corner.position += chunk.positionOffset;
+			}
+			if (corner.relative & relativeNormal)
+			{
+				corner.normal += chunk.normalOffset;
+			}
+			corners[chunk.cornerOffset + c] = corner;
+		}
+
+		for (size_t f = 0; f < chunk.faces.size(); f++)
+		{
+			Face face = chunk.faces[f];
+			face.firstCorner += chunk.cornerOffset;
+			faces[chunk.faceOffset + f] = face;
+		}
+	});
+
+	// Split the faces into meshes at objects, groups and material changes.
+	struct Range
+	{
+		size_t begin, end;
+	};
+	std::vector<Range> ranges;
+	Range current = { 0, 0 };
+	std::string objectName, materialName;
+	for (auto &chunk : chunks)
+	{
+		for (auto &event : chunk.events)
+		{
+			size_t faceIndex = chunk.faceOffset + event.faceIndex;
+			bool split = event.type == Event::Object ?
+				event.name != objectName : event.name != materialName;
+			if (split && faceIndex > current.begin)
+			{
+				ranges.push_back({ current.begin, faceIndex });
+				current.begin = faceIndex;
+			}
+
+			if (event.type == Event::Object)
+			{
+				objectName = event.name;
+			}
+			else
+			{
+				materialName = event.name;
+			}
+		}
+	}
+	if (faceCount > current.begin)
+	{
+		ranges.push_back({ current.begin, faceCount });
+	}
+
+	// Every face corner becomes its own vertex, like Assimp's importer.
+	meshes.resize(ranges.size());
+	parallelFor(ranges.size(), [&](size_t m) {
+		MeshData &mesh = meshes[m];
+		bool hasNormals = false;
+		for (size_t f = ranges[m].begin; f < ranges[m].end && !hasNormals; f++)
+		{
+			for (unsigned int c = 0; c < faces[f].cornerCount; c++)
+			{
+				hasNormals = hasNormals || corners[faces[f].firstCorner + c].normal != noIndex;
+			}
+		}
+
+		for (size_t f = ranges[m].begin; f < ranges[m].end; f++)
+		{
+			const Face &face = faces[f];
+			unsigned int first = mesh.vertices.size();
+			for (unsigned int c = 0; c < face.cornerCount; c++)
+			{
+				const Corner &corner = corners[face.firstCorner + c];
+				Vertex vertex;
+				vertex.position = corner.position >= 0 && size_t(corner.position) < positions.size() ?
+					positions[corner.position] : glm::vec3(0.0f);
+				vertex.normal = corner.normal >= 0 && size_t(corner.normal) < normals.size() ?
+					normals[corner.normal] : glm::vec3(0.0f);
+				mesh.vertices.push_back(vertex);
+			}
+			triangulate(mesh.vertices, first, face.cornerCount, mesh.indices);
+		}
+
+		if (!hasNormals && generateNormals)
+		{
+			generateSmoothNormals(mesh);
+			hasNormals = true;
+		}
+		mesh.hasNormals = hasNormals;
+	});
+
+	return true;
+}
+
+std::vector<ObjParser::MeshData>& ObjParser::getMeshes()
+{
+	return meshes;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ * Parser for Wavefront .obj files that produces the same meshes as
+ * importing them with Assimp using aiProcess_Triangulate and
+ * aiProcess_GenSmoothNormals, without building an aiScene.
+ *
+ * The file is memory mapped and split into chunks that are parsed
+ * in parallel. Only positions, normals and faces are kept. A new
+ * mesh starts at every object or group, and whenever the material
+ * changes, like Assimp's importer does.
+ *
+ * Meshes without normals in the file get smooth normals generated like
+ * aiProcess_GenSmoothNormals does, unless parse() is asked not to.
+ */
+
+#include <string>
+#include <vector>
+
+#include "Vertex.h"
+
+class ObjParser
+{
+	public:
+		/**
+		 * The vertices and triangle indices of one mesh in the file.
+		 * hasNormals is false if the file had none and none were generated,
+		 * then every normal is zero.
+		 */
+		struct MeshData
+		{
+			std::vector<Vertex> vertices;
+			std::vector<unsigned int> indices;
+			bool hasNormals;
+		};
+
+		bool parse(const std::string &objPath, bool generateNormals = true);
+		std::vector<MeshData>& getMeshes();
+
+	private:
+		std::vector<MeshData> meshes;
+};
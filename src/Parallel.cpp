@@ -0,0 +1,107 @@
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <algorithm>
+#include <exception>
+
+#include "Parallel.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	/**
+	 * A running loop, shared with the helpers. Helpers may only start once
+	 * the loop is done, so they hold on to it themselves.
+	 */
+	struct Loop
+	{
+		size_t count;
+		const std::function<void(size_t)>* task;	// only valid until every index completed
+		std::atomic<size_t> next;
+		size_t completed;
+		std::exception_ptr error;	// the first exception a task threw
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+
+	/**
+	 * The helpers, one less than the hardware threads as the caller works too.
+	 */
+	ThreadPool& helpers()
+	{
+		static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+		return pool;
+	}
+
+	/**
+	 * Runs indices of the loop until none are left. An index whose task
+	 * throws still counts as completed so the caller doesn't wait forever.
+	 */
+	void work(Loop &loop)
+	{
+		size_t ran = 0;
+		for (size_t i = loop.next++; i < loop.count; i = loop.next++)
+		{
+			try
+			{
+				(*loop.task)(i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(loop.mutex);
+				if (!loop.error)
+				{
+					loop.error = std::current_exception();
+				}
+			}
+			ran++;
+		}
+
+		if (ran > 0)
+		{
+			std::lock_guard<std::mutex> lock(loop.mutex);
+			loop.completed += ran;
+			if (loop.completed == loop.count)
+			{
+				loop.done.notify_all();
+			}
+		}
+	}
+}
+
+/**
+ * Runs task(i) for every i in [0, count) spread over up to
+ * hardware_concurrency threads, the calling one included. If tasks throw,
+ * the first exception is rethrown once every index has run.
+ */
+void parallelFor(size_t count, const std::function<void(size_t)> &task)
+{
+	size_t threadCount = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+	if (threadCount <= 1)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			task(i);
+		}
+		return;
+	}
+
+	auto loop = std::make_shared<Loop>();
+	loop->count = count;
+	loop->task = &task;
+	loop->next = 0;
+	loop->completed = 0;
+	for (size_t t = 1; t < threadCount; t++)
+	{
+		helpers().submit([loop] { work(*loop); });
+	}
+
+	work(*loop);
+	std::unique_lock<std::mutex> lock(loop->mutex);
+	loop->done.wait(lock, [&loop] { return loop->completed == loop->count; });
+	if (loop->error)
+	{
+		std::rethrow_exception(loop->error);
+	}
+}
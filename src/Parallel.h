@@ -0,0 +1,14 @@
+#pragma once
+
+/*
+ * Splits a loop over the hardware threads. The calling thread works on
+ * the loop itself, helped by a pool of threads shared by every loop, so
+ * loops run on ThreadPool workers, e.g. while importing several models,
+ * don't each start threads of their own. A loop never waits for a
+ * helper to start: if they are all busy the caller runs all of it.
+ */
+
+#include <functional>
+#include <cstddef>
+
+void parallelFor(size_t count, const std::function<void(size_t)> &task);
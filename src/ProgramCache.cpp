@@ -0,0 +1,157 @@
+#include <glad/glad.h>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+#include "ProgramCache.h"
+#include "MappedFile.h"
+#include "Hash.h"
+
+namespace
+{
+	const char magic[8] = { 'P', 'R', 'O', 'G', 'R', 'A', 'M', 'B' };
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t format;			// as reported by glGetProgramBinary
+		uint64_t key;
+		uint64_t size;				// of the binary following the header
+	};
+
+	const char* glString(GLenum name)
+	{
+		const GLubyte* string = glGetString(name);
+		return string ? reinterpret_cast<const char*>(string) : "";
+	}
+}
+
+/**
+ * Must be created on the thread that owns the OpenGL context. The directory
+ * is created when the first program is stored.
+ */
+ProgramCache::ProgramCache(const std::string &directory) : directory(directory)
+{
+	const char* renderer = glString(GL_RENDERER);
+	const char* glVersion = glString(GL_VERSION);
+	driverHash = hash(renderer, strlen(renderer) + 1);
+	driverHash = hash(glVersion, strlen(glVersion) + 1, driverHash);
+
+	int formats = 0;
+	if (GLAD_GL_VERSION_4_1)
+	{
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+	supported = formats > 0;
+}
+
+/**
+ * The key of the program linked from sources, each with its defines already
+ * inserted.
+ */
+uint64_t ProgramCache::getKey(const std::vector<std::string> &sources) const
+{
+	uint64_t key = driverHash;
+	for (auto &source : sources)
+	{
+		// With the terminator, text moved from one source to the next changes the key.
+		key = hash(source.c_str(), source.size() + 1, key);
+	}
+	return key;
+}
+
+/**
+ * Loads the stored binary of key into program, which must not be linked
+ * yet. Returns true if the program is linked and ready to use.
+ */
+bool ProgramCache::load(unsigned int program, uint64_t key) const
+{
+	if (!supported)
+	{
+		return false;
+	}
+
+	MappedFile file(pathOf(key));
+	const Header* header = reinterpret_cast<const Header*>(file.data());
+	bool valid = file.isOpen() && file.size() >= sizeof(Header) &&
+		memcmp(header->magic, magic, sizeof(magic)) == 0 &&
+		header->version == version &&
+		header->key == key &&
+		file.size() - sizeof(Header) >= header->size;
+	if (!valid)
+	{
+		return false;
+	}
+
+	glProgramBinary(program, header->format, file.data() + sizeof(Header), header->size);
+	int linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		std::cerr << "Driver rejected cached program " << pathOf(key) << ", compiling it from source" << std::endl;
+	}
+	return linked;
+}
+
+/**
+ * Stores the binary of the linked program under key. The program should be
+ * linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+ */
+bool ProgramCache::store(unsigned int program, uint64_t key) const
+{
+	if (!supported)
+	{
+		return false;
+	}
+
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	if (length <= 0)
+	{
+		return false;
+	}
+
+	Header header = {};
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.format = format;
+	header.key = key;
+	header.size = length;
+
+	std::string path = pathOf(key);
+	std::string tempPath = path + ".tmp";
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(binary.data(), length);
+	out.close();
+
+	bool written = bool(out);
+	if (written)
+	{
+		std::filesystem::rename(tempPath, path, error);
+	}
+
+	if (!written || error)
+	{
+		std::cerr << "Could not write program cache " << path << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
+
+std::string ProgramCache::pathOf(uint64_t key) const
+{
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << key << ".program";
+	return (std::filesystem::path(directory) / name.str()).string();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * Linked shader programs stored on disk with glGetProgramBinary, so
+ * later runs skip compiling and linking them. A program is stored
+ * under a key hashed from its sources, defines included, and the
+ * GL_RENDERER and GL_VERSION strings, so another GPU or driver looks
+ * for a different file. A binary the driver rejects all the same is
+ * treated like a missing one: the program is compiled from source
+ * and stored again.
+ */
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class ProgramCache
+{
+	public:
+		ProgramCache(const std::string &directory);
+
+		uint64_t getKey(const std::vector<std::string> &sources) const;
+		bool load(unsigned int program, uint64_t key) const;
+		bool store(unsigned int program, uint64_t key) const;
+
+	private:
+		static const uint32_t version = 1;
+
+		std::string directory;
+		uint64_t driverHash;		// of GL_RENDERER and GL_VERSION
+		bool supported;				// the driver has at least one binary format
+
+		std::string pathOf(uint64_t key) const;
+};
@@ -5,19 +5,133 @@
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 #include <filesystem>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
 
 #include "Renderer.h"
+#include "UniformBlocks.h"
 
-Renderer::Renderer(const char* modelDirectory) :
-	modelIndex(0), rotate(0.0f), scale(1.0f), rotationSpeed(glm::radians(5.0f)),
-	scaleSpeed(1.1f)
+namespace
+{
+	/**
+	 * Writes text as a quoted JSON string.
+	 */
+	void writeJsonString(std::ostream &out, const std::string &text)
+	{
+		out << '"';
+		for (unsigned char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				out << '\\' << c;
+			}
+			else if (c < 0x20)
+			{
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c)
+					<< std::dec << std::setfill(' ');
+			}
+			else
+			{
+				out << c;
+			}
+		}
+		out << '"';
+	}
+
+	/**
+	 * Side of the square grid count models are laid out in.
+	 */
+	unsigned int gridSide(unsigned int count)
+	{
+		return std::max(1u, static_cast<unsigned int>(std::ceil(std::sqrt(double(count)))));
+	}
+
+	/**
+	 * Places the model at index in a square grid of count models facing the
+	 * default camera. The grid covers about the same part of the view however
+	 * many models there are.
+	 */
+	glm::mat4 gridTransform(unsigned int index, unsigned int count)
+	{
+		const float extent = 1.6f;		// side of the grid at the origin
+		unsigned int side = gridSide(count);
+		float cell = extent / side;
+		glm::vec3 center((index % side + 0.5f) * cell - extent / 2, (index / side + 0.5f) * cell - extent / 2, 0.0f);
+		// Models are fit to a unit box, leave some space between them.
+		return glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(0.8f * cell));
+	}
+
+	/**
+	 * count instances in a grid, see gridTransform(). The roughness rises
+	 * from left to right and the color changes from color at the bottom to
+	 * blue at the top.
+	 */
+	std::vector<Instance> buildInstanceGrid(unsigned int count, const glm::vec3 &color)
+	{
+		const glm::vec3 blue(0.2f, 0.35f, 0.75f);
+		unsigned int side = gridSide(count);
+		float step = side > 1 ? 1.0f / (side - 1) : 0.0f;
+
+		std::vector<Instance> instances(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			instances[i].transform = gridTransform(i, count);
+			instances[i].material = glm::vec4(glm::mix(color, blue, i / side * step), 0.05f + 0.95f * (i % side) * step);
+		}
+		return instances;
+	}
+}
+
+Renderer::Renderer(const char* modelPath, const Settings& settings) :
+	settings(settings), modelIndex(0), watcher(nullptr), archive(nullptr), uploads(nullptr), rotate(0.0f), scale(1.0f), rotationSpeed(glm::radians(5.0f)),
+	scaleSpeed(1.1f), settingsVersion(1), uploadedSettingsVersion(0), uniformBytes(0)
 {
 	initWindow();
-	shader = new Shader("shaders/vertex.glsl", "shaders/fragment.glsl");
-	shader->link();
 
-	loadModels(modelDirectory);
+	// The BRDF terms on at start, they select the first program.
+	fragmentSettings.useBeckmann = true;
+	fragmentSettings.useGGX = false;
+	fragmentSettings.useG = true;
+	fragmentSettings.useF = true;
+	fragmentSettings.usePi = true;
+	fragmentSettings.useDenom = true;
+
+	programCache = settings.shaderCachePath.empty() ? nullptr : new ProgramCache(settings.shaderCachePath);
+	shaders = new ShaderPermutations("shaders/vertex.glsl", "shaders/fragment.glsl", programCache);
+	program = &shaders->get(getShaderFlags());
+
+	cameraUniforms = new UniformBuffer(UniformBlocks::CameraBinding, sizeof(UniformBlocks::Camera));
+	lightUniforms = new UniformBuffer(UniformBlocks::LightsBinding, sizeof(UniformBlocks::Lights));
+	settingsUniforms = new UniformBuffer(UniformBlocks::SettingsBinding, sizeof(UniformBlocks::Settings));
+
+	// A few frames' worth of staging space, the GPU may still be reading
+	// the last ones while the next is written.
+	if (settings.uploadBudget > 0 && UploadManager::isSupported())
+	{
+		uploads = new UploadManager(4 * settings.uploadBudget, settings.uploadBudget);
+	}
+
+	loadModels(modelPath);
+	drawnIndex = models.size();
+	selectModel(0);
+
+	if (settings.sceneMode && (settings.scenePath.empty() || !loadScene(settings.scenePath)))
+	{
+		for (unsigned int i = 0; i < models.size(); i++)
+		{
+			scene.push_back({ i, gridTransform(i, models.size()) });
+		}
+	}
+
+	// An archive is a snapshot, changes to the model files don't matter.
+	if (settings.watchModels && !archive)
+	{
+		watcher = new DirectoryWatcher(modelPath);
+	}
 	
 	// Setup perspective and camera matricies.
 	perspective = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 100.0f);
@@ -52,24 +166,21 @@ Renderer::Renderer(const char* modelDirectory) :
 		glm::vec3(0.98f, 0.97f, 0.95f), // SIlver
 	};
 
-	shader->use();
-	shader->setUniformMatrix4fv("perspective", perspective);
-	shader->setUniformMatrix4fv("view", view);
-
+	// The camera and the lights never change, they are uploaded once.
+	UniformBlocks::Camera camera;
+	camera.view = view;
+	camera.perspective = perspective;
 	// This extracts the position of the camera.
-	glm::vec3 toCamera = glm::inverse(view) * glm::vec4(0.f, 0.f, 0.f, 1.f);
-	shader->setUniform3fv("toCamera", 1, &toCamera);
-	//std::cout<<glm::to_string(toCamera)<<std::endl;
+	camera.toCamera = glm::inverse(view) * glm::vec4(0.f, 0.f, 0.f, 1.f);
+	cameraUniforms->update(&camera);
 
-	shader->setUniform3fv("lightColors", lightColors.size(), lightColors.data());
-	shader->setUniform3fv("lightPositions", lightPositions.size(), lightPositions.data());
-
-	fragmentSettings.useBeckmann = true;
-	fragmentSettings.useGGX = false;
-	fragmentSettings.useG = true;
-	fragmentSettings.useF = true;
-	fragmentSettings.usePi = true;
-	fragmentSettings.useDenom = true;
+	UniformBlocks::Lights lights;
+	for (size_t i = 0; i < lightColors.size(); i++)
+	{
+		lights.positions[i] = glm::vec4(lightPositions[i], 1.0f);
+		lights.colors[i] = glm::vec4(lightColors[i], 1.0f);
+	}
+	lightUniforms->update(&lights);
 
 	fragmentSettings.roughness = 0.0f;
 	fragmentSettings.ambientStrength = 0.15f;
@@ -78,16 +189,26 @@ Renderer::Renderer(const char* modelDirectory) :
 	fragmentSettings.surfaceColor = glm::vec3(0.722f, 0.451f, 0.2f);
 	fragmentSettings.fresnel = fresnels[6];
 
-	glUseProgram(0);	// unbind shader
+	if (settings.instanceCount > 0)
+	{
+		instanceGrid = buildInstanceGrid(settings.instanceCount, fragmentSettings.surfaceColor);
+	}
 }
 
 Renderer::~Renderer()
 {
-	for (auto m : models)
+	for (auto &handle : models)
 	{
-		delete std::get<Model*>(m);
+		releaseModel(handle);
 	}
-	delete shader;
+	delete uploads;
+	delete watcher;
+	delete archive;
+	delete cameraUniforms;
+	delete lightUniforms;
+	delete settingsUniforms;
+	delete shaders;
+	delete programCache;
 }
 
 void Renderer::initWindow()
@@ -144,23 +265,430 @@ void Renderer::initWindow()
 	glEnable(GL_DEPTH_TEST);
 }
 
-void Renderer::loadModels(const char* modelDirectory)
+/**
+ * Imports every model in the directory in parallel on the worker threads.
+ * Only the GPU upload happens here on the context thread, in directory order,
+ * as each model finishes importing.
+ *
+ * If modelPath is a MeshArchive instead of a directory, the models are the
+ * ones packed into it, and their meshes are read from it. The directory
+ * next to the archive is only read for models it can't provide.
+ *
+ * In lazy mode the directory is only listed. Models are imported when
+ * selected, see selectModel().
+ */
+void Renderer::loadModels(const char* modelPath)
 {
 	namespace fs = std::filesystem;
 	const std::string extension = ".obj";
 
+	if (fs::is_regular_file(modelPath))
+	{
+		archive = new MeshArchive(modelPath);
+		settings.import.archive = archive;
+		fs::path directory = fs::path(modelPath).parent_path();
+		for (const std::string &name : archive->getNames())
+		{
+			models.push_back({ (directory / name).string(), nullptr, {}, {}, false });
+		}
+	}
+	else
+	{
+		for (const auto& entry : fs::directory_iterator(modelPath))
+		{
+			if (entry.is_regular_file() && entry.path().extension() == extension)
+			{
+				models.push_back({ entry.path(), nullptr, {}, {}, false });
+			}
+		}
+	}
+
+	if (settings.lazyLoading)
+	{
+		std::cout << "Found " << models.size() << " models, loading on demand.\n\n";
+		return;
+	}
+
+	const Shader& modelShader = *program;
+	const Model::ImportSettings& import = settings.import;
+	for (auto &handle : models)
+	{
+		std::string path = handle.path;
+		handle.pending = workers.submit([path, &modelShader, &import] {
+			return std::unique_ptr<Model>(new Model(path, modelShader, import));
+		});
+	}
+
 	unsigned int count = 1;
-	for (const auto& entry : fs::directory_iterator(modelDirectory))
+	for (auto &handle : models)
 	{
-		if (entry.is_regular_file() && entry.path().extension() == extension)
+		std::cout << "Loading " << handle.path << "...";
+		Model* model = acquireModel(handle);
+		std::cout << "Done! Index: " << count << '\n';
+		count++;
+
+		MeshOptimizer::Statistics before, after;
+		if (model->getOptimizationStatistics(before, after))
 		{
-			std::cout << "Loading " << entry.path().string() << "...";
-			models.push_back(std::make_tuple(entry.path(), new Model(entry.path(), *shader)));
-			std::cout << "Done! Index: " << count << '\n';
-			count++;
+			std::cout << std::fixed << std::setprecision(3)
+				<< "  Optimized: vertices " << before.vertexCount << " -> " << after.vertexCount
+				<< ", ACMR " << before.acmr << " -> " << after.acmr
+				<< ", ATVR " << before.atvr << " -> " << after.atvr
+				<< ", overdraw " << before.overdraw << " -> " << after.overdraw << '\n';
+		}
+
+		VertexPacking::Error error;
+		if (model->getQuantizationError(error))
+		{
+			std::cout << std::setprecision(6)
+				<< "  Quantized: position error " << error.position << " of the diagonal"
+				<< ", normal error " << error.normalDegrees << " degrees"
+				<< ", N.L error " << error.shading << '\n';
 		}
 	}
 	std::cout << '\n';
+	reportLoads();
+}
+
+/**
+ * Reads where to place the models in scene mode. Every line of the file is
+ * the file name of a model followed by its position and optionally a scale,
+ * e.g. "teapot.obj 0.5 0 -1 0.5", and a model may be placed several times.
+ * Empty lines and lines starting with # are skipped. Returns false if the
+ * file couldn't be read or placed nothing.
+ */
+bool Renderer::loadScene(const std::string &scenePath)
+{
+	namespace fs = std::filesystem;
+
+	std::ifstream in(scenePath);
+	if (!in)
+	{
+		std::cerr << "Could not read scene " << scenePath << std::endl;
+		return false;
+	}
+
+	std::string line;
+	for (unsigned int number = 1; std::getline(in, line); number++)
+	{
+		std::istringstream fields(line);
+		std::string name;
+		glm::vec3 position;
+		float size = 1.0f;
+		if (!(fields >> name) || name[0] == '#')
+		{
+			continue;
+		}
+		if (!(fields >> position.x >> position.y >> position.z))
+		{
+			std::cerr << scenePath << ":" << number << ": expected a model and its position" << std::endl;
+			continue;
+		}
+		fields >> size;
+
+		auto handle = std::find_if(models.begin(), models.end(), [&name](const ModelHandle &handle) {
+			return fs::path(handle.path).filename() == name;
+		});
+		if (handle == models.end())
+		{
+			std::cerr << scenePath << ":" << number << ": no model " << name << std::endl;
+			continue;
+		}
+		glm::mat4 transform = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(size));
+		scene.push_back({ static_cast<unsigned int>(handle - models.begin()), transform });
+	}
+	return !scene.empty();
+}
+
+/**
+ * Prints how long each model took to load and how much memory it takes, see
+ * Model::LoadStatistics, and writes the same as JSON if a report file is set.
+ */
+void Renderer::reportLoads() const
+{
+	namespace fs = std::filesystem;
+	const char* phases[] = { "read", "import", "traverse", "extract", "process", "upload" };
+
+	std::cout << std::left << std::setw(24) << "Model" << std::right;
+	for (const char* phase : phases)
+	{
+		std::cout << std::setw(10) << phase;
+	}
+	std::cout << std::setw(10) << "total" << std::setw(12) << "CPU KiB" << std::setw(12) << "GPU KiB" << '\n';
+
+	std::ofstream json;
+	if (!settings.loadReport.empty())
+	{
+		json.open(settings.loadReport);
+		json << std::fixed << std::setprecision(3) << "{\n  \"models\": [";
+	}
+
+	double sums[7] = {};
+	size_t cpuBytes = 0, gpuBytes = 0;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		const Model::LoadStatistics &statistics = models[i].model->getLoadStatistics();
+		const double milliseconds[] = {
+			statistics.readMilliseconds, statistics.importMilliseconds, statistics.traverseMilliseconds,
+			statistics.extractMilliseconds, statistics.processMilliseconds, statistics.uploadMilliseconds
+		};
+		double total = 0.0;
+		for (size_t p = 0; p < 6; p++)
+		{
+			total += milliseconds[p];
+			sums[p] += milliseconds[p];
+		}
+		sums[6] += total;
+		cpuBytes += statistics.cpuBytes;
+		gpuBytes += statistics.gpuBytes;
+
+		std::cout << std::fixed << std::setprecision(2) << std::left << std::setw(24)
+			<< fs::path(models[i].path).filename().string() << std::right;
+		for (double phase : milliseconds)
+		{
+			std::cout << std::setw(10) << phase;
+		}
+		std::cout << std::setw(10) << total << std::setw(12) << statistics.cpuBytes / 1024
+			<< std::setw(12) << statistics.gpuBytes / 1024 << '\n';
+
+		if (json.is_open())
+		{
+			json << (i > 0 ? ",\n    {" : "\n    {") << "\"path\": ";
+			writeJsonString(json, models[i].path);
+			json << ", \"milliseconds\": {";
+			for (size_t p = 0; p < 6; p++)
+			{
+				json << '"' << phases[p] << "\": " << milliseconds[p] << ", ";
+			}
+			json << "\"total\": " << total << "}, \"cpuBytes\": " << statistics.cpuBytes
+				<< ", \"gpuBytes\": " << statistics.gpuBytes << '}';
+		}
+	}
+
+	std::cout << std::left << std::setw(24) << "All" << std::right;
+	for (double sum : sums)
+	{
+		std::cout << std::setw(10) << sum;
+	}
+	std::cout << std::setw(12) << cpuBytes / 1024 << std::setw(12) << gpuBytes / 1024 << "\n\n";
+
+	if (json.is_open())
+	{
+		json << "\n  ]\n}\n";
+		json.close();
+	}
+	if (!settings.loadReport.empty() && !json)
+	{
+		std::cerr << "Could not write load report " << settings.loadReport << std::endl;
+	}
+}
+
+/**
+ * Imports every model on the worker threads and writes their meshes into a
+ * MeshArchive at archivePath, in directory order, for later runs to load
+ * instead of the directory. Nothing is uploaded.
+ */
+bool Renderer::packModels(const std::string &archivePath)
+{
+	namespace fs = std::filesystem;
+
+	const Shader& modelShader = *program;
+	const Model::ImportSettings& import = settings.import;
+	std::vector<std::future<std::unique_ptr<Model>>> imports;
+	for (auto &handle : models)
+	{
+		std::string path = handle.path;
+		imports.push_back(workers.submit([path, &modelShader, &import] {
+			return std::unique_ptr<Model>(new Model(path, modelShader, import));
+		}));
+	}
+
+	MeshArchive::Writer writer(archivePath);
+	size_t packed = 0;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		const std::string &path = models[i].path;
+		std::unique_ptr<Model> model = imports[i].get();
+
+		std::ostream &out = writer.beginModel(fs::path(path).filename().string());
+		bool written = model->getMeshCount() > 0 && model->writeMeshCache(out, path, import);
+		writer.endModel(written);
+		model.reset();
+
+		if (written)
+		{
+			std::cout << "Packed " << path << '\n';
+			packed++;
+		}
+		else
+		{
+			std::cerr << "Could not pack " << path << std::endl;
+		}
+	}
+
+	if (!writer.finish())
+	{
+		return false;
+	}
+	std::cout << "Wrote " << packed << " of " << models.size() << " models to " << archivePath << '\n';
+	return true;
+}
+
+/**
+ * Makes the model at index the current one. In lazy mode this imports it if
+ * needed, starts importing its neighbours in the background and releases
+ * models that are now too far away to be selected soon.
+ */
+void Renderer::selectModel(unsigned int index)
+{
+	if (index >= models.size())
+	{
+		return;
+	}
+	modelIndex = index;
+	acquireModel(models[index]);
+
+	if (!settings.lazyLoading)
+	{
+		return;
+	}
+
+	const Shader& modelShader = *program;
+	const Model::ImportSettings& import = settings.import;
+	for (unsigned int i = 0; i < models.size(); i++)
+	{
+		ModelHandle& handle = models[i];
+		unsigned int distance = i > index ? i - index : index - i;
+
+		bool importing = handle.pending.valid() &&
+			handle.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+
+		if (distance > settings.prefetchRadius)
+		{
+			// Don't stall on imports still running, they are freed on a later selection.
+			// The model drawn until the selected one has streamed in is kept too.
+			if (!importing && i != drawnIndex)
+			{
+				releaseModel(handle);
+			}
+		}
+		else if (!handle.model && !handle.pending.valid())
+		{
+			// Only import on the worker. The upload happens if it gets selected.
+			std::string path = handle.path;
+			handle.pending = workers.submit([path, &modelShader, &import] {
+				return std::unique_ptr<Model>(new Model(path, modelShader, import));
+			});
+		}
+	}
+}
+
+/**
+ * Returns the model of the handle, ready to be drawn. Waits for a background
+ * import if one is running, otherwise imports it on the calling thread.
+ */
+Model* Renderer::acquireModel(ModelHandle& handle)
+{
+	if (!handle.model)
+	{
+		handle.model = handle.pending.valid() ? handle.pending.get().release() : new Model(handle.path, *program, settings.import);
+		handle.model->upload(uploads);
+	}
+	return handle.model;
+}
+
+/**
+ * Frees the CPU and GPU memory of the model. An import that is still running
+ * is waited on so its result can be freed as well.
+ */
+void Renderer::releaseModel(ModelHandle& handle)
+{
+	if (handle.pending.valid())
+	{
+		handle.pending.get();
+	}
+	if (handle.reloading.valid())
+	{
+		handle.reloading.get();
+	}
+	handle.stale = false;
+	delete handle.model;
+	handle.model = nullptr;
+}
+
+/**
+ * Starts reimporting every resident model whose file changed on a worker,
+ * and swaps in the reimported models that are ready. Called between frames,
+ * so it never waits for an import. Models that aren't resident are simply
+ * imported from the new file once they are acquired.
+ */
+void Renderer::reloadChangedModels()
+{
+	namespace fs = std::filesystem;
+
+	if (!watcher)
+	{
+		return;
+	}
+
+	const Shader& modelShader = *program;
+	const Model::ImportSettings& import = settings.import;
+	auto reload = [&](ModelHandle& handle) {
+		std::string path = handle.path;
+		handle.stale = false;
+		handle.reloading = workers.submit([path, &modelShader, &import] {
+			return std::unique_ptr<Model>(new Model(path, modelShader, import));
+		});
+	};
+
+	for (const std::string &changed : watcher->poll())
+	{
+		for (auto &handle : models)
+		{
+			if (!handle.model || fs::path(handle.path).filename() != fs::path(changed).filename())
+			{
+				continue;
+			}
+			if (handle.reloading.valid())
+			{
+				// Reimport once more when the running one is done, it may have read the old file.
+				handle.stale = true;
+			}
+			else
+			{
+				reload(handle);
+			}
+		}
+	}
+
+	for (auto &handle : models)
+	{
+		if (!handle.reloading.valid() ||
+				handle.reloading.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			continue;
+		}
+
+		Model* model = handle.reloading.get().release();
+		if (model->getMeshCount() == 0)
+		{
+			// Most likely saved halfway, keep drawing the previous version.
+			std::cerr << "Could not reload " << handle.path << ", keeping the previous model" << std::endl;
+			delete model;
+		}
+		else
+		{
+			bool reused = model->uploadReplacing(*handle.model);
+			delete handle.model;
+			handle.model = model;
+			std::cout << "Reloaded " << handle.path << (reused ? " into its previous buffers" : "") << '\n';
+		}
+
+		if (handle.stale)
+		{
+			reload(handle);
+		}
+	}
 }
 
 void Renderer::run()
@@ -168,17 +696,71 @@ void Renderer::run()
 
 	while(!glfwWindowShouldClose(window))
 	{
+		reloadChangedModels();
+
+		// Stream this frame's share of the uploads. The selected model is
+		// drawn once all of it arrived, the previous one until then.
+		if (uploads)
+		{
+			uploads->update();
+		}
+		for (unsigned int i = 0; i < models.size(); i++)
+		{
+			if (models[i].model && models[i].model->finishUpload() && i == modelIndex)
+			{
+				drawnIndex = modelIndex;
+			}
+		}
+
+		uploadSettings();
+
 		glClearColor(0.2f, 0.25f, 0.45f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		Model &model = *(std::get<Model*>(models[modelIndex]));
+		if (settings.sceneMode)
+		{
+			for (auto &handle : models)
+			{
+				if (handle.model && handle.model->finishUpload())
+				{
+					Model &model = *handle.model;
+					if (&model.getShader() != program)
+					{
+						model.setShader(*program);
+					}
+					model.rotate(rotate);
+					model.scale(scale);
+					model.update();
+				}
+			}
+			for (auto &placement : scene)
+			{
+				Model* model = models[placement.modelIndex].model;
+				if (model && model->finishUpload())
+				{
+					queue.add(model, placement.transform);
+				}
+			}
+		}
+		else if (drawnIndex < models.size())
+		{
+			Model &model = *models[drawnIndex].model;
+			if (model.getInstanceCount() != instanceGrid.size())
+			{
+				model.setInstances(instanceGrid);
+			}
+			if (&model.getShader() != program)
+			{
+				model.setShader(*program);
+			}
 
-		model.rotate(rotate);
-		model.scale(scale);
-		model.setFragmentShaderSettings(fragmentSettings);
-		model.update();
-		model.draw();
+			model.rotate(rotate);
+			model.scale(scale);
+			model.update();
+			queue.add(&model);
+		}
+		queue.submit(view, perspective, height);
 
 		rotate = glm::vec3(0.0f);
 		scale = 1;
@@ -204,7 +786,8 @@ void Renderer::keyCallback(GLFWwindow* window, int key, int scancode, int action
 
 	if(action == GLFW_REPEAT || action == GLFW_PRESS)
 	{
-		Model::FragmentShaderSettings& fragmentSettings = renderer->fragmentSettings;
+		FragmentShaderSettings& fragmentSettings = renderer->fragmentSettings;
+		const FragmentShaderSettings previous = fragmentSettings;
 		float change = 0.05f;
 
 		if(!(mods & GLFW_MOD_SHIFT))
@@ -219,7 +802,7 @@ void Renderer::keyCallback(GLFWwindow* window, int key, int scancode, int action
 				case GLFW_KEY_5:
 				case GLFW_KEY_6:
 				case GLFW_KEY_7:
-					renderer->modelIndex = key - GLFW_KEY_1;
+					renderer->selectModel(key - GLFW_KEY_1);
 					break;
 				// Rotations
 				case GLFW_KEY_W:
@@ -374,17 +957,77 @@ void Renderer::keyCallback(GLFWwindow* window, int key, int scancode, int action
 					break;
 			}
 		}
+
+		if (fragmentSettings != previous)
+		{
+			renderer->settingsVersion++;
+		}
 	}
 }
 
+/**
+ * Uploads the fragment shader settings if a key changed them since the
+ * last frame and selects the program with the BRDF terms that are on.
+ * Only the bytes that differ are sent.
+ */
+void Renderer::uploadSettings()
+{
+	uniformBytes = 0;
+	if (uploadedSettingsVersion == settingsVersion)
+	{
+		return;
+	}
+
+	program = &shaders->get(getShaderFlags());
+
+	UniformBlocks::Settings block = {};
+	block.roughness = fragmentSettings.roughness;
+	block.ambientStrength = fragmentSettings.ambientStrength;
+	block.diffuseStrength = fragmentSettings.diffuseStrength;
+	block.specularStrength = fragmentSettings.specularStrength;
+	block.surfaceColor = glm::vec4(fragmentSettings.surfaceColor, 1.0f);
+	block.fresnel = glm::vec4(fragmentSettings.fresnel, 1.0f);
+
+	uniformBytes = settingsUniforms->update(&block);
+	uploadedSettingsVersion = settingsVersion;
+}
+
+/**
+ * The ShaderPermutations flags of the BRDF terms that are on.
+ */
+unsigned int Renderer::getShaderFlags() const
+{
+	return (fragmentSettings.useBeckmann ? ShaderPermutations::Beckmann : 0) |
+		(fragmentSettings.useGGX ? ShaderPermutations::GGX : 0) |
+		(fragmentSettings.useG ? ShaderPermutations::G : 0) |
+		(fragmentSettings.useF ? ShaderPermutations::F : 0) |
+		(fragmentSettings.useDenom ? ShaderPermutations::Denom : 0) |
+		(fragmentSettings.usePi ? ShaderPermutations::Pi : 0);
+}
+
 void Renderer::printSettings(bool clear)
 {
-	std::string &path = (std::get<std::string>(models[modelIndex]));
-	unsigned int lines = 15;
+	std::string &path = models[modelIndex].path;
+	const DrawQueue::Statistics &submitted = queue.getStatistics();
+	const Model::DrawStatistics &statistics = submitted.models;
+	const UploadManager::Statistics uploaded = uploads ? uploads->getStatistics() : UploadManager::Statistics{};
+	Model::MemoryStatistics memory = {};
+	for (auto &handle : models)
+	{
+		if (handle.model)
+		{
+			Model::MemoryStatistics model = handle.model->getMemoryStatistics();
+			memory.cpuBytes += model.cpuBytes;
+			memory.mappedBytes += model.mappedBytes;
+			memory.gpuBytes += model.gpuBytes;
+			memory.releasedBytes += model.releasedBytes;
+		}
+	}
+	unsigned int lines = 23;
 
 	auto boolStr = [](bool value){ return value ? "on" : "off"; };
 
-	std::cout << "Model: " <<  path << '\n'
+	std::cout << "Model: " <<  path << (settings.sceneMode ? " (scene)" : drawnIndex != modelIndex ? " (streaming)" : "") << '\n'
 	   << "Index: " << modelIndex + 1 << '\n'
 	   << "Roughness: " << std::fixed << std::setprecision(3) << fragmentSettings.roughness << '\n'
 	   << "Ambient: " << fragmentSettings.ambientStrength << '\n'
@@ -400,7 +1043,20 @@ void Renderer::printSettings(bool clear)
 	   << "G: " << boolStr(fragmentSettings.useG) << '\n'
 	   << "F: " << boolStr(fragmentSettings.useF) << '\n'
 	   << "Denominator: " << boolStr(fragmentSettings.useDenom) << '\n'
-	   << "Pi: " << boolStr(fragmentSettings.usePi) << '\n';
+	   << "Pi: " << boolStr(fragmentSettings.usePi) << '\n'
+	   << "Triangles: " << statistics.triangles
+	   << (statistics.instances > 0 ? " in " + std::to_string(statistics.instances) + " instances" : "") << '\n'
+	   << "Meshes culled: " << statistics.meshesCulled << " of " << statistics.meshesTested << '\n'
+	   << "Meshlets culled: " << statistics.meshletsCulled << " of " << statistics.meshletsTested << '\n'
+	   << "Draw calls: " << submitted.drawCalls << " for " << submitted.draws << " models, "
+	   << submitted.programChanges << " program and " << submitted.vertexArrayChanges << " vertex array changes" << '\n'
+	   << "Uploaded: " << uploaded.bytes / 1024 << " KiB, " << uploaded.queuedBytes / 1024 << " KiB queued, stalled "
+	   << uploaded.stallMilliseconds << " ms" << '\n'
+	   << "Memory: CPU " << memory.cpuBytes / 1024 << " KiB, mapped " << memory.mappedBytes / 1024 << " KiB, GPU "
+	   << memory.gpuBytes / 1024 << " KiB, released " << memory.releasedBytes / 1024 << " KiB" << '\n'
+	   << "Uniforms uploaded: " << uniformBytes << " bytes, settings version " << settingsUniforms->getVersion() << '\n'
+	   << "Programs compiled: " << shaders->getCompiledCount() << " of " << (1 << ShaderPermutations::flagCount)
+	   << ", " << shaders->getCachedCount() << " from cache" << '\n';
 
 	if (clear) {
 		// Move to beginning of line
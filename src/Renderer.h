@@ -7,22 +7,115 @@
 #include <vector>
 #include <array>
 #include <string>
-#include <tuple>
+#include <future>
+#include <memory>
 
 #include "Model.h"
+#include "ThreadPool.h"
+#include "DirectoryWatcher.h"
+#include "UploadManager.h"
+#include "DrawQueue.h"
+#include "UniformBuffer.h"
+#include "ShaderPermutations.h"
 
 class Renderer
 {
 	public:
-		Renderer(const char* modelDirectory);
+		/**
+		 * Options chosen on the command line.
+		 */
+		struct Settings
+		{
+			bool lazyLoading;				// import models only when selected
+			unsigned int prefetchRadius;	// neighbouring indices to import ahead in lazy mode
+			bool watchModels;				// reimport models whose files change
+			size_t uploadBudget;			// bytes streamed to the GPU per frame, 0 uploads models at once
+			std::string loadReport;			// write the load statistics as JSON to this file if not empty
+			unsigned int instanceCount;		// draw the model this many times in a grid, 0 draws it once
+			bool sceneMode;					// draw every model at once instead of the selected one
+			std::string scenePath;			// where to place the models in scene mode, a grid if empty
+			std::string shaderCachePath;	// directory of the program binaries, none if empty
+			Model::ImportSettings import;
+		};
+
+		Renderer(const char* modelPath, const Settings& settings);
 		~Renderer();
 		void run();
+		bool packModels(const std::string &archivePath);
 
 	private:
+		/**
+		 *	Settings of the fragment shader, see uploadSettings().
+		 */
+		struct FragmentShaderSettings
+		{
+			bool useBeckmann;
+			bool useGGX;
+			bool useG;
+			bool useF;
+			bool useDenom;
+			bool usePi;
+			
+			float roughness;
+			float ambientStrength;
+			float diffuseStrength;
+			float specularStrength;
+
+			glm::vec3 surfaceColor;
+			glm::vec3 fresnel;
+
+			bool operator==(const FragmentShaderSettings &other) const
+			{
+				return useBeckmann == other.useBeckmann && useGGX == other.useGGX && useG == other.useG &&
+					useF == other.useF && useDenom == other.useDenom && usePi == other.usePi &&
+					roughness == other.roughness && ambientStrength == other.ambientStrength &&
+					diffuseStrength == other.diffuseStrength && specularStrength == other.specularStrength &&
+					surfaceColor == other.surfaceColor && fresnel == other.fresnel;
+			}
+
+			bool operator!=(const FragmentShaderSettings &other) const
+			{
+				return !(*this == other);
+			}
+		};
+
 		GLFWwindow* window;
-		Shader* shader;
-		std::vector<std::tuple<std::string, Model*>> models;
+		ProgramCache* programCache;		// nullptr if programs are always compiled
+		ShaderPermutations* shaders;
+		const Shader* program;			// the variant of shaders for the BRDF terms that are on
+		/**
+		 * A model in the model directory. In lazy mode the model is only
+		 * imported and uploaded once it is selected or prefetched.
+		 */
+		struct ModelHandle
+		{
+			std::string path;
+			Model* model;										// nullptr while not resident
+			std::future<std::unique_ptr<Model>> pending;	// import running on a worker
+			std::future<std::unique_ptr<Model>> reloading;	// reimport of a changed file running on a worker
+			bool stale;											// changed again while reloading
+		};
+
+		/**
+		 * Where a model is drawn in scene mode. A model may be placed
+		 * several times.
+		 */
+		struct Placement
+		{
+			unsigned int modelIndex;
+			glm::mat4 transform;
+		};
+
+		Settings settings;
+		std::vector<ModelHandle> models;
+		std::vector<Placement> scene;
+		DrawQueue queue;
 		unsigned int modelIndex;
+		unsigned int drawnIndex;		// the model drawn while modelIndex's still streams in
+		ThreadPool workers;
+		DirectoryWatcher* watcher;
+		MeshArchive* archive;		// the models are read from if not nullptr
+		UploadManager* uploads;		// streams models to the GPU if not nullptr
 
 		const unsigned int height = 800;
 		const unsigned int width = 800;
@@ -39,10 +132,25 @@ class Renderer
 		std::array<glm::vec3, 2> lightColors;
 		std::array<glm::vec3, 2> lightPositions;
 		std::array<glm::vec3, 10> fresnels;
-		Model::FragmentShaderSettings fragmentSettings;
+		FragmentShaderSettings fragmentSettings;
+		uint64_t settingsVersion;			// bumped by every change to fragmentSettings
+		uint64_t uploadedSettingsVersion;	// the version settingsUniforms holds
+		size_t uniformBytes;				// uploaded to the uniform buffers by the last frame
+		UniformBuffer* cameraUniforms;		// the blocks shared by every program, see UniformBlocks
+		UniformBuffer* lightUniforms;
+		UniformBuffer* settingsUniforms;
+		std::vector<Instance> instanceGrid;	// set on the drawn model, see Settings::instanceCount
 
 		void initWindow();
 		static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
-		void loadModels(const char* modelDirectory);
+		void loadModels(const char* modelPath);
+		void reportLoads() const;
+		bool loadScene(const std::string &scenePath);
+		void selectModel(unsigned int index);
+		Model* acquireModel(ModelHandle& handle);
+		void releaseModel(ModelHandle& handle);
+		void reloadChangedModels();
+		void uploadSettings();
+		unsigned int getShaderFlags() const;
 		void printSettings(bool clear);
 };
@@ -7,20 +7,34 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Shader.h"
-Shader::Shader(std::string vertexShaderPath, std::string fragmentShaderPath)
+#include "UniformBlocks.h"
+Shader::Shader(std::string vertexShaderPath, std::string fragmentShaderPath, const std::string &defines,
+		const ProgramCache* cache) :
+	defines(defines), cache(cache), cacheKey(0), cached(false)
 {
 	id = glCreateProgram();
 
-	compileShader(vertexShaderPath, GL_VERTEX_SHADER);
-	compileShader(fragmentShaderPath, GL_FRAGMENT_SHADER);
+	std::vector<std::string> sources = { readShaderFile(vertexShaderPath), readShaderFile(fragmentShaderPath) };
+	if (cache)
+	{
+		cacheKey = cache->getKey(sources);
+		cached = cache->load(id, cacheKey);
+	}
+	if (!cached)
+	{
+		compileShader(sources[0], vertexShaderPath, GL_VERTEX_SHADER);
+		compileShader(sources[1], fragmentShaderPath, GL_FRAGMENT_SHADER);
+	}
 }
 
-Shader::~Shader() {}
+Shader::~Shader()
+{
+	glDeleteProgram(id);
+}
 
-bool Shader::compileShader(std::string shaderPath, unsigned int type)
+bool Shader::compileShader(const std::string &shaderSource, const std::string &shaderPath, unsigned int type)
 {
 	unsigned int shader = glCreateShader(type);
-	std::string shaderSource = readShaderFile(shaderPath); 
 	const char* sSource = shaderSource.c_str();
 	glShaderSource(shader, 1, &sSource, nullptr);
 	glCompileShader(shader);
@@ -56,8 +70,23 @@ bool Shader::compileShader(std::string shaderPath, unsigned int type)
 	return success;
 }
 
+/**
+ * Links the compiled shaders and stores the program in the cache, unless it
+ * was loaded from there already linked.
+ */
 bool Shader::link()
 {
+	if (cached)
+	{
+		readActiveUniforms();
+		bindUniformBlocks();
+		return true;
+	}
+
+	if (cache && GLAD_GL_VERSION_4_1)
+	{
+		glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glLinkProgram(id);
 
 	char infoLog[1024];
@@ -69,16 +98,137 @@ bool Shader::link()
 		std::cerr << "PROGRAM LINKAGE FAILED\n" << infoLog << std::endl;
 		
 	}
+	else if (cache)
+	{
+		cache->store(id, cacheKey);
+	}
 
 	// No longer need individual shaders.
 	for(auto shader : shaders)
 	{
 		glDeleteShader(shader);
 	}
-	
+
+	if (success)
+	{
+		readActiveUniforms();
+		bindUniformBlocks();
+	}
 	return success;
 }
 
+/**
+ * Points every uniform block the program uses at its binding point, so the
+ * UniformBuffers bound there are shared by all programs.
+ */
+void Shader::bindUniformBlocks()
+{
+	int count = 0;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	for (int i = 0; i < count; i++)
+	{
+		char name[256];
+		glGetActiveUniformBlockName(id, i, sizeof(name), nullptr, name);
+		int binding = UniformBlocks::bindingOf(name);
+		if (binding < 0)
+		{
+			std::cerr << "No binding point for uniform block " << name << std::endl;
+			continue;
+		}
+		glUniformBlockBinding(id, i, binding);
+	}
+}
+
+/**
+ * Lists the uniforms the linked program uses with their locations, so they
+ * never have to be looked up by name in the driver again.
+ */
+void Shader::readActiveUniforms()
+{
+	int count = 0;
+	int maxLength = 0;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	uniforms.clear();
+	std::vector<char> name(maxLength + 1);
+	for (int i = 0; i < count; i++)
+	{
+		int length = 0;
+		ActiveUniform uniform;
+		glGetActiveUniform(id, i, name.size(), &length, &uniform.size, &uniform.type, name.data());
+		uniform.location = glGetUniformLocation(id, name.data());
+		if (uniform.location < 0)
+		{
+			// A member of a uniform block, set through its UniformBuffer.
+			continue;
+		}
+
+		// Arrays are reported as their first element.
+		std::string key(name.data(), length);
+		if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+		{
+			key.resize(key.size() - 3);
+		}
+		uniforms[key] = uniform;
+	}
+}
+
+/**
+ * The location of the active uniform, or -1 if the program has none of that
+ * name and type. Each miss is logged once.
+ */
+int Shader::findUniform(const char *uniform, unsigned int type) const
+{
+	auto found = uniforms.find(uniform);
+	// Bools are set like ints.
+	bool matches = found != uniforms.end() && (found->second.type == type ||
+			(type == GL_INT && found->second.type == GL_BOOL));
+	if (matches)
+	{
+		return found->second.location;
+	}
+
+	std::lock_guard<std::mutex> lock(reportMutex);
+	if (reported.insert(uniform).second)
+	{
+		std::cerr << (found == uniforms.end() ? "No active uniform " : "Wrong type for uniform ")
+			<< uniform << std::endl;
+	}
+	return -1;
+}
+
+namespace
+{
+	template<typename T> unsigned int uniformType();
+	template<> unsigned int uniformType<int>() { return GL_INT; }
+	template<> unsigned int uniformType<float>() { return GL_FLOAT; }
+	template<> unsigned int uniformType<glm::vec3>() { return GL_FLOAT_VEC3; }
+	template<> unsigned int uniformType<glm::vec4>() { return GL_FLOAT_VEC4; }
+	template<> unsigned int uniformType<glm::mat4>() { return GL_FLOAT_MAT4; }
+}
+
+/**
+ * Resolves the handle of a uniform. Only reads the table made by link(), so
+ * it needs no OpenGL context and may be called from any thread.
+ */
+template<typename T>
+Shader::Uniform<T> Shader::getUniform(const char *uniform) const
+{
+	Uniform<T> handle;
+	handle.location = findUniform(uniform, uniformType<T>());
+	return handle;
+}
+
+template Shader::Uniform<int> Shader::getUniform<int>(const char *uniform) const;
+template Shader::Uniform<float> Shader::getUniform<float>(const char *uniform) const;
+template Shader::Uniform<glm::vec3> Shader::getUniform<glm::vec3>(const char *uniform) const;
+template Shader::Uniform<glm::vec4> Shader::getUniform<glm::vec4>(const char *uniform) const;
+template Shader::Uniform<glm::mat4> Shader::getUniform<glm::mat4>(const char *uniform) const;
+
+/**
+ * The source of the shader with the defines inserted after its #version.
+ */
 std::string Shader::readShaderFile(std::string shaderPath)
 {
 	std::ifstream in(shaderPath);
@@ -88,9 +238,26 @@ std::string Shader::readShaderFile(std::string shaderPath)
 		return ss.str();
 	}();
 	in.close();
+
+	if (!defines.empty())
+	{
+		// Nothing but comments may come before #version.
+		size_t at = buffer.find("#version");
+		if (at != std::string::npos)
+		{
+			at = buffer.find('\n', at);
+			at = at == std::string::npos ? buffer.size() : at + 1;
+		}
+		buffer.insert(at == std::string::npos ? 0 : at, defines);
+	}
 	return buffer;
 }
 
+bool Shader::isFromCache() const
+{
+	return cached;
+}
+
 void Shader::use() const
 {
 	glUseProgram(id);
@@ -101,32 +268,27 @@ unsigned int Shader::getId() const
 	return id;
 }
 
-void Shader::setUniform1i(const char *uniform, int value) const
+void Shader::set(Uniform<int> uniform, int value) const
 {
-	GLint uniformLocation = glGetUniformLocation(id, uniform);
-	glUniform1i(uniformLocation, value);
+	glUniform1i(uniform.location, value);
 }
 
-void Shader::setUniform1f(const char *uniform, float value) const
+void Shader::set(Uniform<float> uniform, float value) const
 {
-	GLint uniformLocation = glGetUniformLocation(id, uniform);
-	glUniform1f(uniformLocation, value);
+	glUniform1f(uniform.location, value);
 }
 
-void Shader::setUniformMatrix4fv(const char *uniform, const glm::mat4 &matrix) const
+void Shader::set(Uniform<glm::mat4> uniform, const glm::mat4 &matrix) const
 {
-	GLint uniformLocation = glGetUniformLocation(id, uniform);
-	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(matrix));
+	glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(matrix));
 }
 
-void Shader::setUniform3fv(const char *uniform, size_t count, const glm::vec3* vec) const
+void Shader::set(Uniform<glm::vec3> uniform, const glm::vec3* vec, size_t count) const
 {
-	GLint uniformLocation = glGetUniformLocation(id, uniform);
-	glUniform3fv(uniformLocation, count, glm::value_ptr(vec[0]));
+	glUniform3fv(uniform.location, count, glm::value_ptr(vec[0]));
 }
 
-void Shader::setUniform4fv(const char *uniform, const glm::vec4 &vec) const
+void Shader::set(Uniform<glm::vec4> uniform, const glm::vec4 &vec) const
 {
-	GLint uniformLocation = glGetUniformLocation(id, uniform);
-	glUniform4fv(uniformLocation, 1, glm::value_ptr(vec));
+	glUniform4fv(uniform.location, 1, glm::value_ptr(vec));
 }
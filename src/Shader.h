@@ -2,30 +2,75 @@
 
 /*
  * Compiles multiples shaders and links them into
- * a shader program
+ * a shader program. Defines, one "#define NAME" line each, are
+ * inserted after the #version line of every shader, see
+ * ShaderPermutations. With a ProgramCache, a program linked before
+ * is loaded as a binary instead of being compiled again.
  */
 
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
 #include <glm/glm.hpp>
 
+#include "ProgramCache.h"
+
 class Shader
 {
 	public:
-		Shader(std::string vertexShaderPath, std::string fragmentShaderPath);
+		/**
+		 * Handle of an active uniform of type T, resolved once with
+		 * getUniform() and set without looking up its name again. Bool
+		 * uniforms are set as int. An unresolved handle sets nothing.
+		 */
+		template<typename T>
+		struct Uniform
+		{
+			int location = -1;
+		};
+
+		Shader(std::string vertexShaderPath, std::string fragmentShaderPath, const std::string &defines = "",
+				const ProgramCache* cache = nullptr);
 		~Shader();
 		unsigned int getId() const;
-		bool compileShader(std::string shaderPath, unsigned int type);
 		bool link();
+		bool isFromCache() const;
 		void use() const;
-		void setUniform1i(const char *uniform, int value) const;
-		void setUniform1f(const char *uniform, float value) const;
-		void setUniformMatrix4fv(const char *uniform, const glm::mat4 &matrix) const;
-		void setUniform3fv(const char *uniform, size_t count, const glm::vec3* vec) const;
-		void setUniform4fv(const char *uniform, const glm::vec4 &vec) const;
+
+		template<typename T>
+		Uniform<T> getUniform(const char *uniform) const;
+		void set(Uniform<int> uniform, int value) const;
+		void set(Uniform<float> uniform, float value) const;
+		void set(Uniform<glm::mat4> uniform, const glm::mat4 &matrix) const;
+		void set(Uniform<glm::vec3> uniform, const glm::vec3* vec, size_t count = 1) const;
+		void set(Uniform<glm::vec4> uniform, const glm::vec4 &vec) const;
 
 	private:
+		/**
+		 * An active uniform as reported by the linked program.
+		 */
+		struct ActiveUniform
+		{
+			int location;
+			unsigned int type;
+			int size;				// number of elements of an array
+		};
+
 		unsigned int id;
+		std::string defines;
+		const ProgramCache* cache;	// nullptr to always compile from source
+		uint64_t cacheKey;
+		bool cached;				// loaded from the cache, already linked
 		std::vector<unsigned int> shaders;
+		std::unordered_map<std::string, ActiveUniform> uniforms;	// by name, without [0] for arrays
+		mutable std::unordered_set<std::string> reported;	// misses already logged
+		mutable std::mutex reportMutex;		// handles may be resolved on other threads
+
+		bool compileShader(const std::string &shaderSource, const std::string &shaderPath, unsigned int type);
 		std::string readShaderFile(std::string shaderPath);
+		void readActiveUniforms();
+		void bindUniformBlocks();
+		int findUniform(const char *uniform, unsigned int type) const;
 };
@@ -0,0 +1,87 @@
+#include <iostream>
+
+#include "ShaderPermutations.h"
+
+namespace
+{
+	const char* flagNames[ShaderPermutations::flagCount] = { "BECKMANN", "GGX", "G", "F", "DENOM", "PI" };
+}
+
+ShaderPermutations::ShaderPermutations(const std::string &vertexShaderPath, const std::string &fragmentShaderPath,
+		const ProgramCache* cache) :
+	vertexShaderPath(vertexShaderPath), fragmentShaderPath(fragmentShaderPath), cache(cache)
+{
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+	for (auto &program : programs)
+	{
+		delete program.second;
+	}
+}
+
+/**
+ * The program with exactly the terms in flags, a combination of Flag.
+ * Loads or compiles it the first time, which must happen on the thread that owns the
+ * OpenGL context. A variant that fails to link is kept all the same so it
+ * is only reported once.
+ */
+const Shader& ShaderPermutations::get(unsigned int flags)
+{
+	auto program = programs.find(flags);
+	if (program != programs.end())
+	{
+		return *program->second;
+	}
+
+	Shader* shader = new Shader(vertexShaderPath, fragmentShaderPath, definesOf(flags), cache);
+	if (!shader->link())
+	{
+		std::cerr << "Could not link the shader variant" << (flags ? "" : " without any terms");
+		for (unsigned int i = 0; i < flagCount; i++)
+		{
+			if (flags & (1 << i))
+			{
+				std::cerr << " " << flagNames[i];
+			}
+		}
+		std::cerr << std::endl;
+	}
+	programs[flags] = shader;
+	return *shader;
+}
+
+/**
+ * How many of the 64 variants were compiled or loaded so far.
+ */
+size_t ShaderPermutations::getCompiledCount() const
+{
+	return programs.size();
+}
+
+/**
+ * How many of the variants were loaded from the cache.
+ */
+size_t ShaderPermutations::getCachedCount() const
+{
+	size_t count = 0;
+	for (auto &program : programs)
+	{
+		count += program.second->isFromCache();
+	}
+	return count;
+}
+
+std::string ShaderPermutations::definesOf(unsigned int flags)
+{
+	std::string defines;
+	for (unsigned int i = 0; i < flagCount; i++)
+	{
+		if (flags & (1 << i))
+		{
+			defines += std::string("#define USE_") + flagNames[i] + "\n";
+		}
+	}
+	return defines;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * The variants of a pair of shaders for every combination of the BRDF
+ * terms. Each flag turns into a #define, so the terms that are off are
+ * compiled out instead of being branched around on every fragment.
+ * Variants are loaded from the ProgramCache or else compiled and
+ * linked the first time they are asked for, and kept until the
+ * permutations are deleted.
+ */
+
+#include <string>
+#include <unordered_map>
+
+#include "Shader.h"
+
+class ShaderPermutations
+{
+	public:
+		/**
+		 * The terms of the fragment shader, defined as USE_<NAME>.
+		 */
+		enum Flag
+		{
+			Beckmann = 1 << 0,
+			GGX = 1 << 1,
+			G = 1 << 2,
+			F = 1 << 3,
+			Denom = 1 << 4,
+			Pi = 1 << 5
+		};
+		static const unsigned int flagCount = 6;
+
+		ShaderPermutations(const std::string &vertexShaderPath, const std::string &fragmentShaderPath,
+				const ProgramCache* cache);
+		~ShaderPermutations();
+		ShaderPermutations(const ShaderPermutations&) = delete;
+		ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+		const Shader& get(unsigned int flags);
+		size_t getCompiledCount() const;
+		size_t getCachedCount() const;
+
+	private:
+		std::string vertexShaderPath;
+		std::string fragmentShaderPath;
+		const ProgramCache* cache;		// where variants are loaded from and stored, may be nullptr
+		std::unordered_map<unsigned int, Shader*> programs;	// by flags
+
+		static std::string definesOf(unsigned int flags);
+};
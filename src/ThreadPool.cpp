@@ -0,0 +1,59 @@
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount) : stopping(false)
+{
+	if (threadCount == 0)
+	{
+		// hardware_concurrency() may return 0 if it can't tell.
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+/**
+ * Finishes every queued task before joining the workers.
+ */
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (auto &worker : workers)
+	{
+		worker.join();
+	}
+}
+
+unsigned int ThreadPool::size() const
+{
+	return workers.size();
+}
+
+void ThreadPool::work()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+			if (stopping && tasks.empty())
+			{
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+		task();
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ * A fixed size pool of worker threads that runs queued
+ * tasks and hands back their results through futures.
+ */
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+class ThreadPool
+{
+	public:
+		/**
+		 * parameters:
+		 * 		threadCount: Number of workers. 0 uses the number of hardware threads.
+		 */
+		ThreadPool(unsigned int threadCount = 0);
+		~ThreadPool();
+		unsigned int size() const;
+
+		/**
+		 * Queues a task to run on one of the workers. The returned future
+		 * becomes ready once the task has run, rethrowing anything it threw.
+		 */
+		template<typename Function>
+		auto submit(Function task) -> std::future<decltype(task())>
+		{
+			using Result = decltype(task());
+			auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+			std::future<Result> result = packaged->get_future();
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				tasks.push([packaged] { (*packaged)(); });
+			}
+			taskAvailable.notify_one();
+			return result;
+		}
+
+	private:
+		std::vector<std::thread> workers;
+		std::queue<std::function<void()>> tasks;
+		std::mutex queueMutex;
+		std::condition_variable taskAvailable;
+		bool stopping;
+
+		void work();
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+ * The std140 uniform blocks shared by every shader program, each kept
+ * in a UniformBuffer. The structs mirror the blocks in the shaders byte
+ * for byte: a vec3 takes the room of a vec4, also in arrays.
+ */
+
+#include <cstring>
+#include <glm/glm.hpp>
+
+namespace UniformBlocks
+{
+	/**
+	 * Binding point of each block, assigned to every program by
+	 * Shader::link().
+	 */
+	enum Binding
+	{
+		CameraBinding,
+		LightsBinding,
+		SettingsBinding
+	};
+
+	struct Camera
+	{
+		glm::mat4 view;
+		glm::mat4 perspective;
+		glm::vec4 toCamera;			// xyz
+	};
+
+	struct Lights
+	{
+		glm::vec4 positions[2];		// xyz
+		glm::vec4 colors[2];		// rgb
+	};
+
+	/**
+	 * The BRDF terms in use are not part of it, they select the
+	 * program, see ShaderPermutations.
+	 */
+	struct Settings
+	{
+		float roughness;
+		float ambientStrength;
+		float diffuseStrength;
+		float specularStrength;
+		glm::vec4 surfaceColor;		// rgb
+		glm::vec4 fresnel;			// rgb
+	};
+
+	/**
+	 * The binding point of the block with the name used in the shaders, or
+	 * -1 if there is no such block.
+	 */
+	inline int bindingOf(const char* name)
+	{
+		if (strcmp(name, "Camera") == 0)
+		{
+			return CameraBinding;
+		}
+		if (strcmp(name, "Lights") == 0)
+		{
+			return LightsBinding;
+		}
+		if (strcmp(name, "Settings") == 0)
+		{
+			return SettingsBinding;
+		}
+		return -1;
+	}
+}
@@ -0,0 +1,60 @@
+#include <glad/glad.h>
+#include <cstring>
+
+#include "UniformBuffer.h"
+
+UniformBuffer::UniformBuffer(unsigned int binding, size_t size) : uploaded(size), version(0)
+{
+	glGenBuffers(1, &id);
+	glBindBuffer(GL_UNIFORM_BUFFER, id);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, id);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	glDeleteBuffers(1, &id);
+}
+
+/**
+ * Uploads the bytes of block that differ from the last update(), the whole
+ * block the first time. Returns the number of bytes uploaded.
+ */
+size_t UniformBuffer::update(const void* block)
+{
+	const char* bytes = static_cast<const char*>(block);
+	size_t first = 0;
+	size_t end = uploaded.size();
+	if (version > 0)
+	{
+		while (first < end && bytes[first] == uploaded[first])
+		{
+			first++;
+		}
+		while (end > first && bytes[end - 1] == uploaded[end - 1])
+		{
+			end--;
+		}
+		if (first == end)
+		{
+			return 0;
+		}
+	}
+
+	memcpy(uploaded.data() + first, bytes + first, end - first);
+	glBindBuffer(GL_UNIFORM_BUFFER, id);
+	glBufferSubData(GL_UNIFORM_BUFFER, first, end - first, bytes + first);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	version++;
+	return end - first;
+}
+
+/**
+ * Counts the updates that uploaded anything, so users can tell whether the
+ * block changed since they last looked.
+ */
+uint64_t UniformBuffer::getVersion() const
+{
+	return version;
+}
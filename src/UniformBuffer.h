@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * A uniform buffer holding one uniform block, bound to its binding
+ * point for every program. update() compares the block with what was
+ * uploaded last and only sends the range of bytes that changed, so a
+ * frame in which nothing changed sends no uniform data at all.
+ */
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class UniformBuffer
+{
+	public:
+		/**
+		 * parameters:
+		 * 		binding: Binding point of the block, see UniformBlocks.
+		 * 		size: Size of the block in bytes.
+		 */
+		UniformBuffer(unsigned int binding, size_t size);
+		~UniformBuffer();
+		UniformBuffer(const UniformBuffer&) = delete;
+		UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+		size_t update(const void* block);
+		uint64_t getVersion() const;
+
+	private:
+		unsigned int id;
+		std::vector<char> uploaded;	// what the buffer holds
+		uint64_t version;			// number of updates that changed anything
+};
@@ -0,0 +1,209 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "UploadManager.h"
+
+namespace
+{
+	// Copies start at a multiple of this in the ring.
+	const size_t ringAlignment = 16;
+}
+
+UploadManager::UploadManager(size_t ringSize, size_t frameBudget) :
+	ringSize(ringSize), frameBudget(frameBudget), head(0), inFlight(0), nextTicket(0), queuedBytes(0),
+	statistics()
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &ringId);
+	glBindBuffer(GL_COPY_READ_BUFFER, ringId);
+	glBufferStorage(GL_COPY_READ_BUFFER, ringSize, nullptr, flags);
+	ring = static_cast<char*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, ringSize, flags));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+UploadManager::~UploadManager()
+{
+	for (auto &segment : segments)
+	{
+		glDeleteSync(static_cast<GLsync>(segment.fence));
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, ringId);
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glDeleteBuffers(1, &ringId);
+}
+
+/**
+ * True if the context has persistently mapped buffers. Must be called after
+ * the context was created.
+ */
+bool UploadManager::isSupported()
+{
+	return GLAD_GL_VERSION_4_4;
+}
+
+/**
+ * Queues copying size bytes from data to offset in buffer. Returns the
+ * ticket of the copy, see isDone().
+ */
+uint64_t UploadManager::copy(unsigned int buffer, size_t offset, const void* data, size_t size)
+{
+	uint64_t ticket = nextTicket++;
+	if (size > 0)
+	{
+		requests.push_back({ ticket, buffer, offset, static_cast<const char*>(data), size, 0 });
+		queuedBytes += size;
+	}
+	return ticket;
+}
+
+/**
+ * The ticket the next copy() will get. Together with the ticket of the last
+ * one, it brackets a group of copies for isDone() and cancel().
+ */
+uint64_t UploadManager::getNextTicket() const
+{
+	return nextTicket;
+}
+
+/**
+ * True once the copy with the ticket, and every one before it, was issued.
+ */
+bool UploadManager::isDone(uint64_t ticket) const
+{
+	return requests.empty() || requests.front().ticket > ticket;
+}
+
+/**
+ * Drops the queued copies with tickets in [firstTicket, lastTicket], e.g.
+ * because their buffer or data is about to be deleted.
+ */
+void UploadManager::cancel(uint64_t firstTicket, uint64_t lastTicket)
+{
+	auto cancelled = [firstTicket, lastTicket](const Request &request) {
+		return request.ticket >= firstTicket && request.ticket <= lastTicket;
+	};
+	for (auto &request : requests)
+	{
+		if (cancelled(request))
+		{
+			queuedBytes -= request.size - request.copied;
+		}
+	}
+	requests.erase(std::remove_if(requests.begin(), requests.end(), cancelled), requests.end());
+}
+
+/**
+ * Issues the queued copies up to the frame budget. Call once per frame.
+ * Waits for the GPU only if the ring is full and nothing could be copied at
+ * all, otherwise the rest is left for the next frame.
+ */
+void UploadManager::update()
+{
+	statistics = {};
+	reclaim(false);
+
+	size_t frameSize = 0;
+	size_t budget = frameBudget;
+	glBindBuffer(GL_COPY_READ_BUFFER, ringId);
+	while (!requests.empty() && budget > 0)
+	{
+		Request &request = requests.front();
+		// Large copies are split so they never need most of the ring at once.
+		size_t size = std::min({ request.size - request.copied, budget, ringSize / 4 });
+
+		size_t offset;
+		if (!allocate(size, offset, frameSize))
+		{
+			if (statistics.bytes > 0 || segments.empty())
+			{
+				break;
+			}
+			auto start = std::chrono::steady_clock::now();
+			reclaim(true);
+			statistics.stallMilliseconds += std::chrono::duration<double, std::milli>(
+					std::chrono::steady_clock::now() - start).count();
+			continue;
+		}
+
+		memcpy(ring + offset, request.data + request.copied, size);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, request.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, request.offset + request.copied, size);
+
+		request.copied += size;
+		budget -= size;
+		queuedBytes -= size;
+		statistics.bytes += size;
+		if (request.copied == request.size)
+		{
+			statistics.copies++;
+			requests.pop_front();
+		}
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	if (frameSize > 0)
+	{
+		segments.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frameSize });
+	}
+	statistics.queuedBytes = queuedBytes;
+}
+
+const UploadManager::Statistics& UploadManager::getStatistics() const
+{
+	return statistics;
+}
+
+/**
+ * Finds size contiguous bytes after head, wrapping to the start of the ring
+ * if they don't fit before its end. The skipped end and the alignment count
+ * towards this frame's segment.
+ */
+bool UploadManager::allocate(size_t size, size_t &offset, size_t &frameSize)
+{
+	size_t start = (head + ringAlignment - 1) / ringAlignment * ringAlignment;
+	if (start + size > ringSize)
+	{
+		start = 0;
+	}
+	size_t skipped = start >= head ? start - head : ringSize - head;
+	if (inFlight + skipped + size > ringSize)
+	{
+		return false;
+	}
+
+	offset = start;
+	inFlight += skipped + size;
+	frameSize += skipped + size;
+	head = start + size;
+	return true;
+}
+
+/**
+ * Frees the segments the GPU is done with. If wait is set, waits for at
+ * least the oldest one.
+ */
+void UploadManager::reclaim(bool wait)
+{
+	while (!segments.empty())
+	{
+		GLsync fence = static_cast<GLsync>(segments.front().fence);
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		while (wait && status == GL_TIMEOUT_EXPIRED)
+		{
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		}
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			return;
+		}
+
+		glDeleteSync(fence);
+		inFlight -= segments.front().size;
+		segments.pop_front();
+		wait = false;
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * Streams data into GPU buffers over several frames. Copies are
+ * queued, and every frame update() writes up to a budget of them into
+ * a persistently mapped staging ring (GL 4.4 buffer storage) and has
+ * the GPU copy them on into their buffers with glCopyBufferSubData.
+ * A fence at the end of each frame's part of the ring tells when the
+ * GPU is done reading it, so it can be reused without synchronizing.
+ *
+ * Copies are issued in the order they were queued, each identified by
+ * a ticket. Anything drawn after the copy of a ticket was issued sees
+ * its data, so isDone() is all a user has to check.
+ */
+
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+
+class UploadManager
+{
+	public:
+		/**
+		 * What the last update() did.
+		 *	bytes, copies: Copied into GPU buffers.
+		 *	queuedBytes: Still waiting to be copied.
+		 *	stallMilliseconds: Spent waiting for the GPU to free up the ring.
+		 */
+		struct Statistics
+		{
+			size_t bytes;
+			size_t copies;
+			size_t queuedBytes;
+			double stallMilliseconds;
+		};
+
+		/**
+		 * parameters:
+		 * 		ringSize: Size of the staging buffer in bytes.
+		 * 		frameBudget: Most bytes copied by one update().
+		 */
+		UploadManager(size_t ringSize, size_t frameBudget);
+		~UploadManager();
+		UploadManager(const UploadManager&) = delete;
+		UploadManager& operator=(const UploadManager&) = delete;
+
+		static bool isSupported();
+		uint64_t copy(unsigned int buffer, size_t offset, const void* data, size_t size);
+		uint64_t getNextTicket() const;
+		bool isDone(uint64_t ticket) const;
+		void cancel(uint64_t firstTicket, uint64_t lastTicket);
+		void update();
+		const Statistics& getStatistics() const;
+
+	private:
+		/**
+		 * A queued copy. data must stay valid until it is done or cancelled.
+		 */
+		struct Request
+		{
+			uint64_t ticket;
+			unsigned int buffer;
+			size_t offset;
+			const char* data;
+			size_t size;
+			size_t copied;
+		};
+
+		/**
+		 * The part of the ring written by one update(), free again once the
+		 * fence is signaled.
+		 */
+		struct Segment
+		{
+			void* fence;
+			size_t size;
+		};
+
+		unsigned int ringId;
+		char* ring;					// persistently mapped
+		size_t ringSize;
+		size_t frameBudget;
+		size_t head;				// where the next copy is written
+		size_t inFlight;			// bytes the GPU may still read, ending at head
+
+		std::deque<Request> requests;
+		std::deque<Segment> segments;
+		uint64_t nextTicket;
+		size_t queuedBytes;
+		Statistics statistics;
+
+		bool allocate(size_t size, size_t &offset, size_t &frameSize);
+		void reclaim(bool wait);
+};
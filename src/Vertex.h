@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <glm/glm.hpp>
 
 struct Vertex
@@ -7,3 +8,23 @@ struct Vertex
 	glm::vec3 position;
 	glm::vec3 normal;
 };
+
+/**
+ * Compact form of Vertex, see VertexPacking.
+ */
+struct PackedVertex
+{
+	uint16_t position[3];	// normalized against a bounding box
+	uint16_t padding;
+	int16_t normal[2];		// octahedral encoded
+};
+
+/**
+ * What differs between the copies of a model drawn with instancing, see
+ * Model::setInstances().
+ */
+struct Instance
+{
+	glm::mat4 transform;	// applied after the model's own transformation
+	glm::vec4 material;		// surface color in rgb, roughness in a
+};
@@ -1,7 +1,12 @@
 #include <glad/glad.h>
+#include <iostream>
+
 #include "VertexArray.h"
 
-VertexArray::VertexArray(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+VertexArray::VertexArray(size_t vertexCapacity, size_t indexBytes, Format format) :
+	instanceBufferId(0), format(format), vertexSize(format == Packed ? sizeof(PackedVertex) : sizeof(Vertex)),
+	vertexCapacity(vertexCapacity), indexCapacity(indexBytes), vertexCount(0), indexBytes(0),
+	instanceBytes(0)
 {
     glGenBuffers(1, &vertexBufferId); // gen buffer and store id in VBO
 	glGenBuffers(1, &elementBufferId);
@@ -9,18 +14,28 @@ VertexArray::VertexArray(const std::vector<Vertex> &vertices, const std::vector<
     
     glBindVertexArray(id);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
-	glBufferData(GL_ARRAY_BUFFER,  vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER,  vertexCapacity * vertexSize, nullptr, GL_STATIC_DRAW);
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferId);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,  indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER,  indexCapacity, nullptr, GL_STATIC_DRAW);
 
 	// set the vertex attribute pointers
-	// vertex Positions
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-	// vertex normals
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	if (format == Packed)
+	{
+		// vertex Positions, [0, 1] inside the bounding box
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+		// vertex normals, octahedral encoded in [-1, 1]
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+	}
+	else
+	{
+		// vertex Positions
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		// vertex normals
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	}
 
 
 	// unbind VAO, VBO, and EBO
@@ -34,8 +49,150 @@ VertexArray::~VertexArray()
     glDeleteVertexArrays(1, &id);
 	glDeleteBuffers(1, &vertexBufferId);
 	glDeleteBuffers(1, &elementBufferId);
+	glDeleteBuffers(1, &instanceBufferId);
 }       
 
+VertexArray::Range VertexArray::add(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount, size_t indexSize,
+		UploadManager* uploads)
+{
+	if (this->vertexCount + vertexCount > vertexCapacity)
+	{
+		std::cerr << "VertexArray is full, mesh not added." << std::endl;
+		return { 0, 0, 0, GL_UNSIGNED_INT };
+	}
+
+	Range range = addIndices(indices, indexCount, indexSize, int(this->vertexCount), uploads);
+	if (range.indexCount != indexCount)
+	{
+		return range;
+	}
+
+	if (uploads)
+	{
+		uploads->copy(vertexBufferId, this->vertexCount * vertexSize, vertices, vertexCount * vertexSize);
+	}
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
+		glBufferSubData(GL_ARRAY_BUFFER, this->vertexCount * vertexSize, vertexCount * vertexSize, vertices);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	this->vertexCount += vertexCount;
+	return range;
+}
+
+VertexArray::Range VertexArray::addIndices(const void* indices, size_t indexCount, size_t indexSize, int baseVertex,
+		UploadManager* uploads)
+{
+	// Indices must start at a multiple of their size.
+	size_t indexOffset = (indexBytes + indexSize - 1) / indexSize * indexSize;
+
+	if (indexOffset + indexCount * indexSize > indexCapacity)
+	{
+		std::cerr << "VertexArray is full, mesh not added." << std::endl;
+		return { 0, 0, 0, GL_UNSIGNED_INT };
+	}
+
+	Range range = { indexOffset, indexCount, baseVertex,
+		indexSize == sizeof(uint16_t) ? GLenum(GL_UNSIGNED_SHORT) : GLenum(GL_UNSIGNED_INT) };
+
+	if (uploads)
+	{
+		uploads->copy(elementBufferId, indexOffset, indices, indexCount * indexSize);
+	}
+	else
+	{
+		// The element buffer binding is part of the VAO state.
+		glBindVertexArray(id);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, indexCount * indexSize, indices);
+		glBindVertexArray(0);
+	}
+
+	indexBytes = indexOffset + indexCount * indexSize;
+	return range;
+}
+
+/**
+ * Space a mesh needs in the element buffer, including the worst case
+ * padding to align it.
+ */
+size_t VertexArray::indexBytesFor(size_t indexCount, size_t indexSize)
+{
+	return indexCount * indexSize + indexSize - 1;
+}
+
+/**
+ * True if the buffers are large enough for the given totals, see the
+ * constructor, so they can be cleared and reused.
+ */
+bool VertexArray::fits(size_t vertexCount, size_t indexBytes, Format format) const
+{
+	return this->format == format && vertexCount <= vertexCapacity && indexBytes <= indexCapacity;
+}
+
+/**
+ * Forgets every mesh so the next add() writes to the start of the buffers
+ * again. The buffers keep their size, they are only overwritten.
+ */
+void VertexArray::clear()
+{
+	vertexCount = 0;
+	indexBytes = 0;
+}
+
+VertexArray::Format VertexArray::getFormat() const
+{
+	return format;
+}
+
+/**
+ * Size of the buffers, what the vertex array takes on the GPU.
+ */
+size_t VertexArray::getBytes() const
+{
+	return vertexCapacity * vertexSize + indexCapacity + instanceBytes;
+}
+
+/**
+ * Replaces the per instance attributes, at locations 2 to 5 for the columns
+ * of the transform and 6 for the material. With no instances they are
+ * disabled again, so draws that aren't instanced don't read them.
+ */
+void VertexArray::setInstances(const Instance* instances, size_t count)
+{
+	if (count == 0 && !instanceBufferId)
+	{
+		return;
+	}
+
+	glBindVertexArray(id);
+	if (!instanceBufferId)
+	{
+		glGenBuffers(1, &instanceBufferId);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBufferId);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(Instance), instances, GL_STATIC_DRAW);
+	instanceBytes = count * sizeof(Instance);
+
+	for (unsigned int location = 2; location <= 6; location++)
+	{
+		if (count == 0)
+		{
+			glDisableVertexAttribArray(location);
+			continue;
+		}
+		size_t offset = location < 6 ? offsetof(Instance, transform) + (location - 2) * sizeof(glm::vec4) :
+			offsetof(Instance, material);
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offset);
+		glVertexAttribDivisor(location, 1);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 unsigned int VertexArray::getId() const
 {
 	return id;
@@ -1,19 +1,75 @@
 #pragma once
 
-#include <vector>
+#include <cstddef>
 
 #include "Vertex.h"
+#include "UploadManager.h"
 
+/*
+ * One vertex and one element buffer shared by several meshes.
+ * Each mesh is added into its own range of the buffers, and is
+ * drawn with a base vertex so its indices stay relative to itself.
+ */
 class VertexArray
 {
 	public:
+		/**
+		 * Layout of the vertex buffer, either Vertex or PackedVertex.
+		 */
+		enum Format
+		{
+			Float,
+			Packed
+		};
+
+		/**
+		 * Where a mesh lives inside the buffers.
+		 */
+		struct Range
+		{
+			size_t indexOffset;			// in bytes
+			size_t indexCount;
+			int baseVertex;
+			unsigned int indexType;		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		};
+
         /**
 		 * parameters:
-		 * 		vertices: The vertex with all of its data.
-		 * 		indices: Used to index into vertices allowing triangles to share vertices.
+		 * 		vertexCapacity: Total number of vertices of all meshes that will be added.
+		 * 		indexBytes: Total size of the indices of all meshes that will be added,
+		 * 		            see indexBytesFor().
+		 * 		format: Which vertex struct the meshes are added as.
         */
-		VertexArray(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices);
+		VertexArray(size_t vertexCapacity, size_t indexBytes, Format format = Float);
 		~VertexArray();
+
+        /**
+		 * Copies a mesh into the next free part of the buffers.
+		 * parameters:
+		 * 		vertices: The vertex with all of its data, a Vertex or PackedVertex
+		 * 		          depending on getFormat().
+		 * 		vertexCount: Number of vertices.
+		 * 		indices: Used to index into vertices allowing triangles to share vertices.
+		 * 		indexCount: Number of indices.
+		 * 		indexSize: 2 for uint16_t indices or 4 for unsigned int indices.
+		 * 		uploads: If set, the copy is queued there instead of done right
+		 * 		         away, and the data must stay valid until it is done.
+        */
+		Range add(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount, size_t indexSize,
+				UploadManager* uploads = nullptr);
+
+		/**
+		 * Copies more indices for vertices that were already added, e.g. a
+		 * level of detail of a mesh, which is drawn with the same baseVertex.
+		 */
+		Range addIndices(const void* indices, size_t indexCount, size_t indexSize, int baseVertex,
+				UploadManager* uploads = nullptr);
+		static size_t indexBytesFor(size_t indexCount, size_t indexSize);
+		void setInstances(const Instance* instances, size_t count);
+		bool fits(size_t vertexCount, size_t indexBytes, Format format) const;
+		void clear();
+		Format getFormat() const;
+		size_t getBytes() const;
 		unsigned int getId() const;
 		void bind() const;
 
@@ -21,4 +77,13 @@ class VertexArray
 		unsigned int id;
 		unsigned int vertexBufferId;
 		unsigned int elementBufferId;
+		unsigned int instanceBufferId;	// 0 until setInstances()
+
+		Format format;
+		size_t vertexSize;
+		size_t vertexCapacity;
+		size_t indexCapacity;		// in bytes
+		size_t vertexCount;
+		size_t indexBytes;
+		size_t instanceBytes;
 };
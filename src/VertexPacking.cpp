@@ -0,0 +1,129 @@
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+
+#include "VertexPacking.h"
+
+namespace
+{
+	glm::vec2 signNotZero(const glm::vec2 &v)
+	{
+		return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	/**
+	 * Maps the unit sphere onto an octahedron and unfolds it into [-1, 1]^2.
+	 */
+	glm::vec2 encodeOctahedral(const glm::vec3 &n)
+	{
+		float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (sum == 0.0f)
+		{
+			return glm::vec2(0.0f);
+		}
+
+		glm::vec2 p = glm::vec2(n.x, n.y) / sum;
+		if (n.z < 0.0f)
+		{
+			p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * signNotZero(p);
+		}
+		return p;
+	}
+
+	glm::vec3 decodeOctahedral(const glm::vec2 &e)
+	{
+		glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+		if (n.z < 0.0f)
+		{
+			glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signNotZero(glm::vec2(n.x, n.y));
+			n.x = folded.x;
+			n.y = folded.y;
+		}
+		return glm::normalize(n);
+	}
+
+	int16_t toSnorm16(float value)
+	{
+		return int16_t(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	float fromSnorm16(int16_t value)
+	{
+		// Same conversion as OpenGL uses for normalized signed attributes.
+		return glm::max(value / 32767.0f, -1.0f);
+	}
+}
+
+VertexPacking::VertexPacking() : offset(0.0f), scale(1.0f) {}
+
+VertexPacking::VertexPacking(const glm::vec3 &minimum, const glm::vec3 &maximum) :
+	offset(minimum), scale(maximum - minimum)
+{
+	// A flat box would divide by 0.
+	scale = glm::max(scale, glm::vec3(1e-6f));
+}
+
+PackedVertex VertexPacking::pack(const Vertex &vertex) const
+{
+	PackedVertex packed;
+	glm::vec3 normalized = glm::clamp((vertex.position - offset) / scale, 0.0f, 1.0f);
+	for (int i = 0; i < 3; i++)
+	{
+		packed.position[i] = uint16_t(std::round(normalized[i] * 65535.0f));
+	}
+	packed.padding = 0;
+
+	glm::vec2 normal = encodeOctahedral(vertex.normal);
+	packed.normal[0] = toSnorm16(normal.x);
+	packed.normal[1] = toSnorm16(normal.y);
+	return packed;
+}
+
+/**
+ * Decodes a vertex the same way vertex.glsl does.
+ */
+Vertex VertexPacking::unpack(const PackedVertex &packed) const
+{
+	Vertex vertex;
+	glm::vec3 normalized(packed.position[0], packed.position[1], packed.position[2]);
+	vertex.position = offset + normalized / 65535.0f * scale;
+	vertex.normal = decodeOctahedral(glm::vec2(fromSnorm16(packed.normal[0]), fromSnorm16(packed.normal[1])));
+	return vertex;
+}
+
+/**
+ * Packs and unpacks every vertex to find the largest error. Vertices without
+ * a normal are only checked for their position.
+ */
+VertexPacking::Error VertexPacking::measure(const Vertex* vertices, size_t count) const
+{
+	Error error = { 0.0f, 0.0f, 0.0f };
+	const float diagonal = glm::length(scale);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const Vertex &original = vertices[i];
+		Vertex decoded = unpack(pack(original));
+
+		error.position = glm::max(error.position, glm::length(decoded.position - original.position) / diagonal);
+
+		float length = glm::length(original.normal);
+		if (length > 0.0f)
+		{
+			glm::vec3 normal = original.normal / length;
+			float cosine = glm::clamp(glm::dot(normal, decoded.normal), -1.0f, 1.0f);
+			error.normalDegrees = glm::max(error.normalDegrees, glm::degrees(std::acos(cosine)));
+			error.shading = glm::max(error.shading, glm::length(decoded.normal - normal));
+		}
+	}
+	return error;
+}
+
+const glm::vec3& VertexPacking::getOffset() const
+{
+	return offset;
+}
+
+const glm::vec3& VertexPacking::getScale() const
+{
+	return scale;
+}
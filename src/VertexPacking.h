@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * Converts vertices into PackedVertex, half the size of Vertex.
+ * Positions are stored as 16 bit unsigned normalized values inside a
+ * bounding box and normals are octahedral encoded into two 16 bit
+ * signed normalized values. vertex.glsl decodes them again using
+ * the box's offset and scale.
+ */
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+
+class VertexPacking
+{
+	public:
+		/**
+		 * Largest differences between the packed and the original vertices.
+		 *	position: Distance, relative to the bounding box diagonal.
+		 *	normalDegrees: Angle between the decoded and original normals.
+		 *	shading: Difference of N.L for any light direction, which bounds
+		 *	         the error of the diffuse term.
+		 */
+		struct Error
+		{
+			float position;
+			float normalDegrees;
+			float shading;
+		};
+
+		VertexPacking();
+		VertexPacking(const glm::vec3 &minimum, const glm::vec3 &maximum);
+
+		PackedVertex pack(const Vertex &vertex) const;
+		Vertex unpack(const PackedVertex &packed) const;
+		Error measure(const Vertex* vertices, size_t count) const;
+
+		const glm::vec3& getOffset() const;
+		const glm::vec3& getScale() const;
+
+	private:
+		glm::vec3 offset;
+		glm::vec3 scale;
+};
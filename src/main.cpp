@@ -5,20 +5,187 @@
 #include <iostream>
 
 #include "Renderer.h"
+#include "NormalGenerator.h"
 
 int main(int argc, char *argv[])
 {
 	if (argc < 2)
 	{
-		std::cerr << "Usage: " << argv[0] << " <obj_dir>"  << std::endl;
+		std::cerr << "Usage: " << argv[0] << " <obj_dir|archive> [options]"  << std::endl;
 		return -1;
 	}
 
+	Renderer::Settings settings;
+	settings.lazyLoading = false;
+	settings.prefetchRadius = 1;
+	settings.watchModels = false;
+	settings.uploadBudget = 8 * 1024 * 1024;
+	settings.instanceCount = 0;
+	settings.sceneMode = false;
+	settings.shaderCachePath = "shadercache";
+	settings.import.useMeshCache = true;
+	settings.import.archive = nullptr;
+	settings.import.useObjParser = false;
+	settings.import.validateObjParser = false;
+	settings.import.generateNormals = false;
+	settings.import.creaseAngle = NormalGenerator::defaultCreaseAngle;
+	settings.import.validateNormals = false;
+	settings.import.optimizeMeshes = false;
+	settings.import.overdrawThreshold = 0.0f;
+	settings.import.quantizeVertices = false;
+	settings.import.validateQuantization = false;
+	settings.import.buildLods = false;
+	settings.import.buildMeshlets = false;
+	settings.import.residency = Mesh::Drop;
+	settings.import.autoFit = true;
+
+	std::string archivePath;	// pack the models into this archive instead of drawing them
+	for (int i = 2; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--lazy")
+		{
+			settings.lazyLoading = true;
+		}
+		else if (option == "--watch")
+		{
+			settings.watchModels = true;
+		}
+		else if (option == "--upload-budget" && i + 1 < argc)
+		{
+			settings.uploadBudget = size_t(std::stod(argv[++i]) * 1024 * 1024);
+		}
+		else if (option == "--scene")
+		{
+			settings.sceneMode = true;
+		}
+		else if (option == "--scene-file" && i + 1 < argc)
+		{
+			settings.sceneMode = true;
+			settings.scenePath = argv[++i];
+		}
+		else if (option == "--instances" && i + 1 < argc)
+		{
+			settings.instanceCount = std::stoul(argv[++i]);
+		}
+		else if (option == "--load-report" && i + 1 < argc)
+		{
+			settings.loadReport = argv[++i];
+		}
+		else if (option == "--pack" && i + 1 < argc)
+		{
+			// Only list the directory, packModels() imports every model.
+			archivePath = argv[++i];
+			settings.lazyLoading = true;
+			settings.prefetchRadius = 0;
+		}
+		else if (option == "--no-cache")
+		{
+			settings.import.useMeshCache = false;
+		}
+		else if (option == "--shader-cache" && i + 1 < argc)
+		{
+			settings.shaderCachePath = argv[++i];
+		}
+		else if (option == "--no-shader-cache")
+		{
+			settings.shaderCachePath.clear();
+		}
+		else if (option == "--obj-parser")
+		{
+			settings.import.useObjParser = true;
+		}
+		else if (option == "--optimize")
+		{
+			settings.import.optimizeMeshes = true;
+		}
+		else if (option == "--overdraw" && i + 1 < argc)
+		{
+			settings.import.optimizeMeshes = true;
+			settings.import.overdrawThreshold = std::stof(argv[++i]);
+		}
+		else if (option == "--quantize")
+		{
+			settings.import.quantizeVertices = true;
+		}
+		else if (option == "--validate-quantization")
+		{
+			settings.import.quantizeVertices = true;
+			settings.import.validateQuantization = true;
+		}
+		else if (option == "--lod")
+		{
+			settings.import.buildLods = true;
+		}
+		else if (option == "--meshlets")
+		{
+			settings.import.buildMeshlets = true;
+		}
+		else if (option == "--residency" && i + 1 < argc)
+		{
+			std::string residency = argv[++i];
+			if (residency != "keep" && residency != "drop" && residency != "compact")
+			{
+				std::cerr << "Unknown residency " << residency << std::endl;
+				return -1;
+			}
+			settings.import.residency = residency == "keep" ? Mesh::Keep :
+				residency == "compact" ? Mesh::Compact : Mesh::Drop;
+		}
+		else if (option == "--no-fit")
+		{
+			settings.import.autoFit = false;
+		}
+		else if (option == "--normals")
+		{
+			settings.import.generateNormals = true;
+		}
+		else if (option == "--crease" && i + 1 < argc)
+		{
+			settings.import.generateNormals = true;
+			settings.import.creaseAngle = std::stof(argv[++i]);
+		}
+		else if (option == "--validate-normals")
+		{
+			// Validating needs an actual import, not the cache.
+			settings.import.generateNormals = true;
+			settings.import.validateNormals = true;
+			settings.import.useMeshCache = false;
+		}
+		else if (option == "--validate-obj-parser")
+		{
+			// Validating needs an actual import, not the cache.
+			settings.import.useObjParser = true;
+			settings.import.validateObjParser = true;
+			settings.import.useMeshCache = false;
+		}
+		else
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			return -1;
+		}
+	}
+
+	// A scene draws every model, they are all loaded up front.
+	if (settings.sceneMode && archivePath.empty())
+	{
+		settings.lazyLoading = false;
+	}
+
+	bool packed = true;
 	{
-		Renderer renderer(argv[1]);
-		renderer.run();
+		Renderer renderer(argv[1], settings);
+		if (archivePath.empty())
+		{
+			renderer.run();
+		}
+		else
+		{
+			packed = renderer.packModels(archivePath);
+		}
 	}
 	// Need to terminate GLFW context after all OpenGL objects are deleted.
 	// Otherwise, a seg fault will occur.
 	glfwTerminate();
+	return packed ? 0 : -1;
 }